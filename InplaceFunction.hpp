@@ -0,0 +1,149 @@
+﻿#ifndef _INPLACEFUNCTION_HPP
+#define _INPLACEFUNCTION_HPP
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+
+template<class Sig, size_t Capacity = 48, bool HeapFallback = false>
+class InplaceFunction;
+
+// 只可移动的回调类型, 可调用对象存放在内部固定大小的缓冲区中, 构造和调用都不分配内存
+// Capacity     缓冲区大小, 字节
+// HeapFallback 可调用对象超过缓冲区大小时是否允许改为堆上分配; 为 false 时编译报错
+template<class R, class... Args, size_t Capacity, bool HeapFallback>
+class InplaceFunction<R(Args...), Capacity, HeapFallback> {
+public:
+	InplaceFunction() noexcept = default;
+
+	InplaceFunction(std::nullptr_t) noexcept {
+	}
+
+	template<class F, class Fn = typename std::decay<F>::type,
+			class = typename std::enable_if<!std::is_same<Fn, InplaceFunction>::value
+			                                && std::is_invocable_r<R, Fn &, Args...>::value>::type>
+	InplaceFunction(F &&f) {
+		_assign<Fn>(std::forward<F>(f));
+	}
+
+	InplaceFunction(InplaceFunction &&other) noexcept {
+		_moveFrom(other);
+	}
+
+	InplaceFunction &operator=(InplaceFunction &&other) noexcept {
+		if (this != &other) {
+			_reset();
+			_moveFrom(other);
+		}
+		return *this;
+	}
+
+	InplaceFunction &operator=(std::nullptr_t) noexcept {
+		_reset();
+		return *this;
+	}
+
+	InplaceFunction(const InplaceFunction &) = delete;
+	InplaceFunction &operator=(const InplaceFunction &) = delete;
+
+	~InplaceFunction() {
+		_reset();
+	}
+
+	explicit operator bool() const noexcept {
+		return _ops != nullptr;
+	}
+
+	R operator()(Args... args) const {
+		return _ops->invoke(const_cast<void *>(static_cast<const void *>(&_buf)), std::forward<Args>(args)...);
+	}
+
+
+private:
+	// 可调用对象的操作表
+	struct Ops {
+		R (*invoke)(void *buf, Args &&...args);
+		void (*move)(void *dst, void *src) noexcept; // 移动到 dst 并析构 src
+		void (*destroy)(void *buf) noexcept;
+	};
+
+	// 存放在缓冲区内的可调用对象
+	template<class Fn>
+	struct InplaceOps {
+		static R invoke(void *buf, Args &&...args) {
+			return (*static_cast<Fn *>(buf))(std::forward<Args>(args)...);
+		}
+
+		static void move(void *dst, void *src) noexcept {
+			new(dst) Fn(std::move(*static_cast<Fn *>(src)));
+			static_cast<Fn *>(src)->~Fn();
+		}
+
+		static void destroy(void *buf) noexcept {
+			static_cast<Fn *>(buf)->~Fn();
+		}
+
+		static constexpr Ops ops = {&invoke, &move, &destroy};
+	};
+
+	// 缓冲区中只存放指针, 可调用对象在堆上
+	template<class Fn>
+	struct HeapOps {
+		static R invoke(void *buf, Args &&...args) {
+			return (**static_cast<Fn **>(buf))(std::forward<Args>(args)...);
+		}
+
+		static void move(void *dst, void *src) noexcept {
+			*static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+		}
+
+		static void destroy(void *buf) noexcept {
+			delete *static_cast<Fn **>(buf);
+		}
+
+		static constexpr Ops ops = {&invoke, &move, &destroy};
+	};
+
+	template<class Fn>
+	struct FitsInplace {
+		static constexpr bool value = sizeof(Fn) <= Capacity
+		                              && alignof(std::max_align_t) % alignof(Fn) == 0
+		                              && std::is_nothrow_move_constructible<Fn>::value;
+	};
+
+	template<class Fn, class F>
+	typename std::enable_if<FitsInplace<Fn>::value>::type _assign(F &&f) {
+		new(&_buf) Fn(std::forward<F>(f));
+		_ops = &InplaceOps<Fn>::ops;
+	}
+
+	template<class Fn, class F>
+	typename std::enable_if<!FitsInplace<Fn>::value>::type _assign(F &&f) {
+		static_assert(HeapFallback, "callable does not fit in InplaceFunction buffer, increase Capacity or enable HeapFallback");
+		*reinterpret_cast<Fn **>(&_buf) = new Fn(std::forward<F>(f));
+		_ops = &HeapOps<Fn>::ops;
+	}
+
+	void _moveFrom(InplaceFunction &other) noexcept {
+		if (other._ops) {
+			other._ops->move(&_buf, &other._buf);
+			_ops = other._ops;
+			other._ops = nullptr;
+		}
+	}
+
+	void _reset() noexcept {
+		if (_ops) {
+			_ops->destroy(&_buf);
+			_ops = nullptr;
+		}
+	}
+
+	const Ops *_ops = nullptr;                                        // 为空时表示未设置回调
+	typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type _buf; // 可调用对象缓冲区
+};
+
+
+#endif //_INPLACEFUNCTION_HPP
@@ -1,251 +1,1297 @@
 ﻿#ifndef _MINHEAPTIMER_HPP
 #define _MINHEAPTIMER_HPP
 
-#include <map>
+#include <new>
 #include <mutex>
+#include <chrono>
+#include <atomic>
+#include <thread>
 #include <memory>
 #include <vector>
+#include <utility>
+#include <optional>
+#include <memory_resource>
+#include <type_traits>
+#include <condition_variable>
 #include <iostream>
 #include "util_timer.hpp"
+#include "InplaceFunction.hpp"
+#include "TimerDispatchPool.hpp"
+#include "TimerStats.hpp"
+#include "TimerLockStats.hpp"
+#include "TimerTracer.hpp"
+
+
+// 循环定时器错过周期 (过期处理被阻塞) 时的补偿策略
+enum class TimerCatchUp {
+	Burst,    // 逐个补发错过的周期, 连续补发次数不超过 burst_cap, 超出的周期计入 missed
+	FireOnce, // 只触发一次, 错过的周期数记录在 missed 中
+	Skip,     // 直接跳过错过的周期, 不记录
+};
 
+// 定时器 id, 由每个定时器实例的句柄表无锁分配
+using TimerId = int64_t;
 
 // 时间节点
 template<class T>
 struct TimerNode {
 	int idx = 0;                 // 定时器节点在最小堆中的位置索引
-	int id = 0;                  // 定时器节点id
+	TimerId id = 0;              // 定时器节点id
 	uint64_t expire_ms = 0;      // 过期时间, ms; 过期时间 = 创建定时器时间 + 定时时间
 	uint64_t timing_time_ms = 0; // 定时时间, ms
+	uint64_t slack_ms = 0;       // 允许延后触发的时间, ms; 最晚在 expire_ms + slack_ms 触发, 便于与相近的定时器同批触发
+	uint64_t key = UINT64_MAX;   // 回调并行执行时的串行 key, 相同 key 的回调不会并发执行; UINT64_MAX 表示未指定
 
 	T data;                      // 定时器节点存储的数据
 
-	// 定时回调
-	std::function<void(struct TimerNode<T> *node)> fb;
+	bool is_loop = false;    // 是否循环执行; 默认为false; 为true时, 到达时间后会重新将数据添加到定时器中;
+
+	TimerCatchUp catch_up = TimerCatchUp::FireOnce; // 循环定时器错过周期时的补偿策略
+	uint32_t burst_cap = 0;      // Burst 策略的最大连续补发次数, 为 0 时不限
+	uint32_t missed = 0;         // 本次触发合并掉的周期数, 回调中读取; 本次触发代表 missed + 1 个周期
+
+	int firing = 0;                      // 正在等待或执行回调的次数, 大于 0 时节点由过期处理负责释放
+	std::atomic_bool cancelled{false};   // 回调执行前/执行中被删除
 
-	bool is_loop;            // 是否循环执行; 默认为false; 为true时, 到达时间后会重新将数据添加到定时器中;
+	TimerNode() = default;
+
+	// 以 args 直接构造节点数据; 没有参数时 data 为值初始化
+	template<class... Args>
+	explicit TimerNode(std::in_place_t, Args &&...args) : data(std::forward<Args>(args)...) {
+	}
 };
 
 
+// 默认定时回调类型, 可调用对象存放在回调内部, 不分配内存
+template<class T>
+using TimerCallback = InplaceFunction<void(TimerNode<T> *node)>;
+
+// 带回调的定时节点
+// Fb 回调类型, 以 TimerNode<T> * 为参数调用; 可以是静态已知的函数对象类型, 调用可被内联
+template<class T, class Fb>
+struct CallbackTimerNode : public TimerNode<T> {
+	using TimerNode<T>::TimerNode;
+
+	Fb fb;  // 定时回调
+};
+
+template<class Fb>
+inline bool _isCallbackSet(const Fb &fb, std::true_type) {
+	return static_cast<bool>(fb);
+}
+
+template<class Fb>
+inline bool _isCallbackSet(const Fb &, std::false_type) {
+	return true;
+}
+
+// 回调是否已设置; 不能转换为 bool 的回调类型 (如函数对象) 视为已设置
+template<class Fb>
+inline bool IsCallbackSet(const Fb &fb) {
+	return _isCallbackSet(fb, std::is_constructible<bool, const Fb &>());
+}
+
+
+// a + b, 溢出时取 UINT64_MAX
+inline uint64_t TimerSaturatingAdd(uint64_t a, uint64_t b) {
+	return b > UINT64_MAX - a ? UINT64_MAX : a + b;
+}
+
+// 最晚触发时间 expire_ms + slack_ms
+// 定时器按最晚触发时间排序, 定时线程休眠到最早的最晚触发时间; 有定时器到达最晚触发时间时,
+// 其余已到过期时间 (expire_ms <= now) 的定时器合并到同一批触发; 不会早于 expire_ms 触发
+template<class T>
+inline uint64_t TimerSlackExpire(const TimerNode<T> *node) {
+	return TimerSaturatingAdd(node->expire_ms, node->slack_ms);
+}
+
+// 执行节点的回调; stats 不为空时记录触发延迟和回调执行时间, tracer 不为空时记录触发事件
+template<class Node>
+inline void InvokeTimerCallback(Node *node, TimerStats *stats, TimerTracer *tracer = nullptr) {
+	if (!stats && !tracer) {
+		if (IsCallbackSet(node->fb)) {
+			node->fb(node);
+		}
+		return;
+	}
+
+	if (stats) {
+		uint64_t now = TimeUtils::CurrentTime_ms();
+		stats->fires.fetch_add(1, std::memory_order_relaxed);
+		stats->lateness_ms.Record(now > node->expire_ms ? now - node->expire_ms : 0);
+	}
+
+	auto id = node->id;
+	uint64_t ticks = tracer ? TimerTracer::Now() : 0;
+
+	if (IsCallbackSet(node->fb)) {
+		if (stats) {
+			auto start = std::chrono::steady_clock::now();
+			node->fb(node);
+			auto end = std::chrono::steady_clock::now();
+			stats->callback_ns.Record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		} else {
+			node->fb(node);
+		}
+	}
+
+	if (tracer) {
+		tracer->Record(TimerTraceEvent::Fire, id, ticks, TimerTracer::Now() - ticks);
+	}
+}
+
+// 循环定时器的周期, 至少为 1ms
+template<class T>
+inline uint64_t TimerPeriod(const TimerNode<T> *node) {
+	return node->timing_time_ms > 0 ? node->timing_time_ms : 1;
+}
+
+// 按补偿策略计算本次触发后需要跳过的周期数
+// now       当前时间
+template<class T>
+inline uint64_t TimerSkippedPeriods(const TimerNode<T> *node, uint64_t now) {
+	uint64_t period = TimerPeriod(node);
+	if (!node->is_loop || now < node->expire_ms + period) {
+		return 0;
+	}
+
+	uint64_t late = (now - node->expire_ms) / period;  // 已经到期的后续周期数
+	if (node->catch_up != TimerCatchUp::Burst) {
+		return late;
+	}
+	return node->burst_cap > 0 && late > node->burst_cap ? late - node->burst_cap : 0;
+}
+
+// 触发前设置 node->missed
+template<class T>
+inline void TimerPrepareFire(TimerNode<T> *node, uint64_t now) {
+	node->missed = node->catch_up == TimerCatchUp::Skip ? 0 : (uint32_t) TimerSkippedPeriods(node, now);
+}
+
+// 循环定时器的下一次过期时间, 以上次的过期时间为基准, 不累积回调耗时带来的误差
 template<class T>
-class MinHeapTimer {
+inline uint64_t TimerNextPeriod(const TimerNode<T> *node, uint64_t now) {
+	return node->expire_ms + (TimerSkippedPeriods(node, now) + 1) * TimerPeriod(node);
+}
+
+
+// 批量添加的定时器
+template<class T, class Fb>
+struct TimerSpec {
+	uint64_t timing_time_ms = 0; // 定时时间, ms
+	T data;                      // 节点存储数据, 添加时移动到节点中
+	Fb fb;                       // 定时回调
+	bool is_loop = false;        // 是否循环定时
+	uint64_t slack_ms = 0;       // 允许延后触发的时间
+};
+
+
+// 过期处理方式
+enum class TimerExpireMode {
+	Locked,    // 持锁执行全部回调 (默认)
+	Unlocked,  // 持锁取出全部过期节点, 解锁后再执行回调, 回调不阻塞 AddTimer/DelTimer
+};
+
+
+// 定时器节点内存池
+// 节点按 slab 批量向 memory_resource 申请, 释放的节点挂到空闲链表上复用, 稳定运行时不再申请内存;
+// slab 在内存池析构时统一归还
+template<class Node>
+class TimerNodePool {
 public:
-	using TNode = TimerNode<T>;
+	static constexpr size_t MIN_SLAB_NODES = 64;   // 第一个 slab 的节点数
+	static constexpr size_t MAX_SLAB_NODES = 8192; // 单个 slab 最大节点数, slab 大小按 2 倍递增
+
+	explicit TimerNodePool(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+			: _resource(resource) {
+	}
+
+	TimerNodePool(const TimerNodePool &) = delete;
+	TimerNodePool &operator=(const TimerNodePool &) = delete;
+
+	// 调用前需要先释放全部节点
+	~TimerNodePool() {
+		while (_slabs) {
+			Slab *slab = _slabs;
+			_slabs = slab->next;
+			_resource->deallocate(slab, sizeof(Slab) + slab->count * sizeof(Block), alignof(Block));
+		}
+	}
+
+	// 构造节点
+	template<class... Args>
+	Node *New(Args &&...args) {
+		if (!_free) {
+			_grow();
+		}
+
+		Block *block = _free;
+		_free = block->next;
+		return new(block->storage) Node(std::forward<Args>(args)...);
+	}
+
+	// 析构节点并放回空闲链表
+	void Delete(Node *node) {
+		node->~Node();
+
+		Block *block = reinterpret_cast<Block *>(node);
+		block->next = _free;
+		_free = block;
+	}
+
+
+private:
+	union Block {
+		Block *next;                                   // 空闲链表下一个节点
+		alignas(Node) unsigned char storage[sizeof(Node)]; // 节点内存
+	};
+
+	struct alignas(Block) Slab {
+		Slab *next;   // 下一个 slab
+		size_t count; // slab 中的节点数
+	};
+
+	// 申请新的 slab, 将其节点挂到空闲链表
+	void _grow() {
+		size_t count = _slab_nodes;
+		if (_slab_nodes < MAX_SLAB_NODES) {
+			_slab_nodes *= 2;
+		}
+
+		void *mem = _resource->allocate(sizeof(Slab) + count * sizeof(Block), alignof(Block));
+		Slab *slab = new(mem) Slab{_slabs, count};
+		_slabs = slab;
+
+		Block *blocks = reinterpret_cast<Block *>(slab + 1);
+		for (size_t i = count; i > 0; i--) {
+			blocks[i - 1].next = _free;
+			_free = &blocks[i - 1];
+		}
+	}
 
-	MinHeapTimer() {
+	std::pmr::memory_resource *_resource;  // 内存来源
+	Slab *_slabs = nullptr;                // slab 链表
+	Block *_free = nullptr;                // 空闲节点链表
+	size_t _slab_nodes = MIN_SLAB_NODES;   // 下一个 slab 的节点数
+};
+
+
+// 定时器 id 的位布局: (实例标记 << TAG_SHIFT) | (版本号 << SLOT_BITS) | 槽位下标, 最高位为 0 保证 id 为正数
+struct TimerIdBits {
+	static constexpr int SLOT_BITS = 24;                         // 槽位下标位数, 最多同时存在 2^24 个定时器
+	static constexpr int GEN_BITS = 31;                          // 版本号位数, 同一槽位复用 2^31 次后 id 才会重复
+	static constexpr int TAG_BITS = 63 - SLOT_BITS - GEN_BITS;   // 实例标记位数
+	static constexpr int TAG_SHIFT = SLOT_BITS + GEN_BITS;
+	static constexpr uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+	static constexpr uint32_t GEN_MASK = (1u << GEN_BITS) - 1;
+	static constexpr uint32_t TAG_MASK = (1u << TAG_BITS) - 1;
+};
+
+// 定时器句柄表
+// 定时器 id 见 TimerIdBits, 查找/分配/释放均为 O(1), 稳定运行时不分配内存;
+// 槽位释放后版本号递增, 已失效的 id 不会命中复用该槽位的新节点;
+// 实例标记用于区分多个定时器实例 (如分片) 的 id, 标记不同的 id 不会被误认;
+// 槽位按块分配, 扩容时已有槽位地址不变;
+// Reserve 为无锁操作, 可在任意线程预先取得 id; 其余操作需要由定时器持锁调用
+template<class Node>
+class TimerHandleTable : public TimerIdBits {
+public:
+	static constexpr int CHUNK_BITS = 13;                        // 每块槽位数 2^13
+	static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+	static constexpr uint32_t CHUNK_COUNT = 1u << (SLOT_BITS - CHUNK_BITS);
+	static constexpr uint32_t INVALID_SLOT = ~0u;
+
+	TimerHandleTable() {
+		for (auto &chunk : _chunks) {
+			chunk.store(nullptr);
+		}
+	}
+
+	TimerHandleTable(const TimerHandleTable &) = delete;
+	TimerHandleTable &operator=(const TimerHandleTable &) = delete;
+
+	~TimerHandleTable() {
+		for (auto &chunk : _chunks) {
+			delete[] chunk.load();
+		}
+	}
+
+	// 设置实例标记, 需要在分配 id 之前调用
+	void SetTag(uint32_t tag) {
+		_tag = tag & TAG_MASK;
+	}
+
+	// 实例标记
+	inline uint32_t Tag() const {
+		return _tag;
+	}
+
+	// 预留槽位, 返回定时器 id, 需要再调用 Bind 关联节点; 槽位用尽时返回 -1
+	// 无锁, 可以与持锁的其它操作并发
+	TimerId Reserve() {
+		uint64_t head = _free.load(std::memory_order_acquire);
+		for (;;) {
+			uint32_t index = (uint32_t) head;
+			if (index == INVALID_SLOT) {
+				break;
+			}
+
+			uint64_t next = ((head & ~(uint64_t) INVALID_SLOT) + ((uint64_t) 1 << 32))
+			                | _slot(index).next_free.load(std::memory_order_relaxed);
+			if (_free.compare_exchange_weak(head, next, std::memory_order_acquire)) {
+				return _makeId(index);
+			}
+		}
+
+		// 空闲链表为空, 使用新槽位
+		uint32_t index = _size.load(std::memory_order_relaxed);
+		do {
+			if (index > SLOT_MASK) {
+				return -1;
+			}
+		} while (!_size.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
+
+		auto &chunk = _chunks[index >> CHUNK_BITS];
+		if (!chunk.load(std::memory_order_acquire)) {
+			Slot *expected = nullptr;
+			Slot *slots = new Slot[CHUNK_SIZE];
+			if (!chunk.compare_exchange_strong(expected, slots, std::memory_order_acq_rel)) {
+				delete[] slots;  // 其它线程已分配
+			}
+		}
+
+		return _makeId(index);
+	}
+
+	// 将节点关联到预留的 id
+	void Bind(TimerId id, Node *node) {
+		_slot((uint32_t) (id & SLOT_MASK)).node = node;
+		_used++;
+	}
+
+	// 分配槽位, 返回定时器 id; 槽位用尽时返回 -1
+	TimerId Alloc(Node *node) {
+		TimerId id = Reserve();
+		if (id >= 0) {
+			Bind(id, node);
+		}
+		return id;
+	}
+
+	// 根据 id 查找节点, id 无效, 已失效或尚未关联节点时返回 nullptr
+	Node *Find(TimerId id) const {
+		if (id <= 0 || (uint32_t) (id >> TAG_SHIFT) != _tag) {
+			return nullptr;
+		}
+
+		uint32_t index = (uint32_t) (id & SLOT_MASK);
+		Slot *chunk = _chunks[index >> CHUNK_BITS].load(std::memory_order_acquire);
+		if (!chunk) {
+			return nullptr;
+		}
+
+		auto &slot = chunk[index & (CHUNK_SIZE - 1)];
+		if (slot.gen != (uint32_t) ((id >> SLOT_BITS) & GEN_MASK) || slot.node == nullptr) {
+			return nullptr;
+		}
+
+		return slot.node;
+	}
+
+	// 释放 id 对应的槽位, 版本号递增使 id 失效
+	void Free(TimerId id) {
+		uint32_t index = (uint32_t) (id & SLOT_MASK);
+		auto &slot = _slot(index);
+
+		if (slot.node) {
+			_used--;
+		}
+		slot.node = nullptr;
+		slot.gen = (slot.gen + 1) & GEN_MASK;
+		if (slot.gen == 0) {
+			slot.gen = 1;  // 版本号不为 0, 保证 id 不为 0
+		}
+
+		// 放回空闲链表, 高 32 位为防 ABA 的计数
+		uint64_t head = _free.load(std::memory_order_relaxed);
+		uint64_t next;
+		do {
+			slot.next_free.store((uint32_t) head, std::memory_order_relaxed);
+			next = ((head & ~(uint64_t) INVALID_SLOT) + ((uint64_t) 1 << 32)) | index;
+		} while (!_free.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// 遍历全部有效节点
+	template<class F>
+	void ForEach(F &&f) const {
+		uint32_t size = _size.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < size; i++) {
+			Slot *chunk = _chunks[i >> CHUNK_BITS].load(std::memory_order_acquire);
+			if (chunk && chunk[i & (CHUNK_SIZE - 1)].node) {
+				f(chunk[i & (CHUNK_SIZE - 1)].node);
+			}
+		}
+	}
+
+	// 有效节点数量
+	inline size_t Size() const {
+		return _used;
+	}
+
+
+private:
+	struct Slot {
+		Node *node = nullptr;                          // 节点, 空闲或仅预留时为 nullptr
+		uint32_t gen = 1;                              // 版本号
+		std::atomic<uint32_t> next_free{INVALID_SLOT}; // 空闲链表下一个槽位
+	};
+
+	inline Slot &_slot(uint32_t index) const {
+		return _chunks[index >> CHUNK_BITS].load(std::memory_order_relaxed)[index & (CHUNK_SIZE - 1)];
+	}
+
+	inline TimerId _makeId(uint32_t index) const {
+		return ((TimerId) _tag << TAG_SHIFT) | ((TimerId) _slot(index).gen << SLOT_BITS) | index;
+	}
+
+	std::atomic<Slot *> _chunks[CHUNK_COUNT];                 // 槽位块
+	std::atomic<uint32_t> _size{0};                           // 已创建的槽位数量
+	std::atomic<uint64_t> _free{INVALID_SLOT};                // 空闲链表头, 低 32 位为槽位下标
+	size_t _used = 0;                                          // 已关联节点的槽位数量
+	uint32_t _tag = 0;                                         // 实例标记
+};
+
+
+// 定时器公共部分: 互斥锁、节点内存池、句柄表, 以及过期处理方式、运行统计、事件追踪、补偿策略等设置
+// Derived 具体定时器 (CRTP), 需要提供 _takeExpired/_finishExpired, 用于 Unlocked 过期处理
+// Node    定时节点类型
+template<class Derived, class Node>
+class TimerBase {
+public:
+	using Lock = TimerLock;
+
+	// resource 节点使用的内存来源
+	explicit TimerBase(std::pmr::memory_resource *resource) : _pool(resource) {
+	}
+
+	TimerBase(const TimerBase &) = delete;
+	TimerBase &operator=(const TimerBase &) = delete;
+
+	virtual ~TimerBase() = default;
+
+	// 设置过期处理方式
+	// Locked:   回调中可以重入调用 AddTimer/DelTimer (不会再次加锁)
+	// Unlocked: 回调执行时不持锁, 其它线程可以并发 AddTimer/DelTimer;
+	//           同一批次中尚未执行回调的节点被删除后不再回调, 循环定时器在回调中删除自身后不再重新添加
+	void SetExpireMode(TimerExpireMode mode) {
+		auto lock = _lock(); // 加锁
+		_expire_mode = mode;
+	}
+
+	// 启用运行统计, 应在添加定时器之前调用; 启用后每次触发额外读取两次时钟
+	void EnableStats() {
+		auto lock = _lock(); // 加锁
+		if (!_stats) {
+			_stats.reset(new TimerStats());
+		}
+	}
+
+	// 运行统计, 未启用时返回 nullptr; 可以在任意线程不加锁读取
+	const TimerStats *GetStats() const {
+		return _stats.get();
+	}
+
+	// 设置事件追踪器, 为 nullptr 时关闭; tracer 需要在定时器停止使用前保持有效
+	void SetTracer(TimerTracer *tracer) {
+		auto lock = _lock(); // 加锁
+		_tracer = tracer;
+	}
+
+#ifdef TIMER_LOCK_STATS
+	// 按入口分类的 mtx_ 锁统计, 可以在任意线程不加锁读取
+	// 定时线程自身的加锁 (休眠等待、命令处理) 不计入, 其中调用的 ExpireTimer 计入
+	const TimerLockStats &GetLockStats() const {
+		return _lock_stats;
+	}
+
+	// 清空锁统计
+	void ResetLockStats() {
+		_lock_stats.Reset();
+	}
+#endif
+
+	// 设置 id 中的实例标记, 需要在添加定时器之前调用; 多个定时器实例的 id 需要互相区分时使用
+	// tag       实例标记, 取值 [0, 2^TimerIdBits::TAG_BITS)
+	void SetIdTag(uint32_t tag) {
+		auto lock = _lock(); // 加锁
+		_handles.SetTag(tag);
+	}
+
+	// 设置循环定时器错过周期时的补偿策略
+	// policy    补偿策略
+	// burst_cap Burst 策略的最大连续补发次数, 为 0 时不限
+	bool SetCatchUp(TimerId id, TimerCatchUp policy, uint32_t burst_cap = 0) {
+		auto lock = _lock(); // 加锁
+		return _setCatchUp(id, policy, burst_cap);
+	}
+
+	// 设置之后添加的定时器默认使用的补偿策略
+	// 默认为 FireOnce: 过期处理被阻塞后每个循环定时器只补发一次, 错过的周期数记录在 missed 中;
+	// 改为 Burst 且 burst_cap 为 0 时, 阻塞多久就连续补发多少个周期 (如 1ms 定时器阻塞 60s 后补发 60000 次)
+	// policy    补偿策略
+	// burst_cap Burst 策略的最大连续补发次数, 为 0 时不限
+	void SetDefaultCatchUp(TimerCatchUp policy, uint32_t burst_cap = 0) {
+		auto lock = _lock(); // 加锁
+		_catch_up = policy;
+		_burst_cap = burst_cap;
+	}
+
+
+protected:
+	// 加锁; 定义 TIMER_LOCK_STATS 时按入口统计加锁次数、竞争次数和等待/持锁时间
+	inline Lock _acquire(TimerLockSite site) {
+#ifdef TIMER_LOCK_STATS
+		return Lock(mtx_, _lock_stats[site]);
+#else
+		(void) site;
+		return Lock(mtx_);
+#endif
+	}
+
+	// 加锁; 当前线程正在持锁执行定时回调时 (回调中重入) 不再加锁
+	inline Lock _lock(TimerLockSite site = TimerLockSite::Other) {
+		if (_callback_thread.load() == std::this_thread::get_id()) {
+			return Lock(mtx_, std::defer_lock);
+		}
+		return _acquire(site);
+	}
+
+	// 添加定时器节点, 有新节点加入定时器后调用; 需要持锁调用
+	// expire_ms 新节点的过期时间
+	virtual void _onTimerAdded([[maybe_unused]] uint64_t expire_ms) {
+	}
+
+	// 记录追踪事件, 未设置追踪器时不记录
+	inline void _trace(TimerTraceEvent event, TimerId id) {
+		if (_tracer) {
+			_tracer->Record(event, id);
+		}
+	}
+
+	// 设置 id 对应节点的补偿策略, 需要持锁调用
+	bool _setCatchUp(TimerId id, TimerCatchUp policy, uint32_t burst_cap) {
+		auto *node = _handles.Find(id);
+		if (!node) {
+			return false;
+		}
+
+		node->catch_up = policy;
+		node->burst_cap = burst_cap;
+		return true;
+	}
+
+	// 创建节点并关联到预留的 id, 不加入定时器
+	template<class F, class... Args>
+	Node *_newNode(TimerId id, uint64_t now, uint64_t timing_time_ms, F &&fb, bool is_loop, uint64_t slack_ms, Args &&...args) {
+		auto *node = _pool.New(std::in_place, std::forward<Args>(args)...); // 直接构造存储数据
+		_handles.Bind(id, node);
+
+		node->id = id;                    // 定时器id
+		node->expire_ms = now + timing_time_ms; // 过期时间
+		node->timing_time_ms = timing_time_ms; // 定时时间
+		node->slack_ms = slack_ms;        // 容差
+		node->fb = std::forward<F>(fb);   // 回调
+		node->is_loop = is_loop;          // 是否循环触发
+		node->catch_up = _catch_up;       // 补偿策略
+		node->burst_cap = _burst_cap;
+
+		if (slack_ms > _max_slack) {
+			_max_slack = slack_ms;
+		}
+
+		return node;
+	}
+
+	// 持锁执行已到过期时间、但未到最晚触发时间的节点, 在有节点到达最晚触发时间后调用
+	void _fireEarly(uint64_t now) {
+		auto *self = static_cast<Derived *>(this);
+
+		std::vector<Node *> batch;
+		batch.swap(_expired);  // 复用上次的缓冲区
+		self->_takeEarly(now, batch);
+
+		for (auto *node : batch) {
+			if (!node->cancelled.load()) {
+				_callback_thread.store(std::this_thread::get_id());
+				InvokeTimerCallback(node, _stats.get(), _tracer);
+				_callback_thread.store(std::thread::id());
+			}
+			self->_finishExpired(node, now);
+		}
+
+		batch.clear();
+		if (batch.capacity() > _expired.capacity()) {
+			batch.swap(_expired);
+		}
+	}
+
+	// 持锁取出全部过期节点, 解锁执行回调, 再加锁释放或重新添加节点
+	void _expireUnlocked(Lock &lock, uint64_t now) {
+		auto *self = static_cast<Derived *>(this);
+
+		std::vector<Node *> batch;
+		batch.swap(_expired);  // 复用上次的缓冲区
+		self->_takeExpired(now, batch);
+
+		lock.unlock();
+		for (auto *node : batch) {
+			if (!node->cancelled.load()) {
+				InvokeTimerCallback(node, _stats.get(), _tracer);
+			}
+		}
+		lock.lock();
+
+		for (auto *node : batch) {
+			self->_finishExpired(node, now);
+		}
+
+		batch.clear();
+		if (batch.capacity() > _expired.capacity()) {
+			batch.swap(_expired);
+		}
+	}
+
+
+protected:
+	std::mutex mtx_;                  // 互斥锁
+	TimerNodePool<Node> _pool;        // 节点内存池
+	TimerHandleTable<Node> _handles;  // <TimerNode::id, 节点>
+
+	TimerExpireMode _expire_mode = TimerExpireMode::Locked; // 过期处理方式
+	TimerCatchUp _catch_up = TimerCatchUp::FireOnce;        // 新定时器的默认补偿策略
+	uint32_t _burst_cap = 0;                                // 新定时器的默认最大补发次数
+	std::atomic<std::thread::id> _callback_thread{std::thread::id()}; // 持锁执行回调的线程
+	std::vector<Node *> _expired;                           // 过期节点缓冲区
+	uint64_t _max_slack = 0;                                // 已添加定时器的最大容差, 只增不减; 限定合并触发的查找范围
+	std::unique_ptr<TimerStats> _stats;                     // 运行统计, 为空时不统计
+	TimerTracer *_tracer = nullptr;                         // 事件追踪器, 为空时不记录
+#ifdef TIMER_LOCK_STATS
+	TimerLockStats _lock_stats;                             // mtx_ 锁统计
+#endif
+};
+
+
+// 最小堆定时器
+// D  堆的分叉数, 默认为 4 叉堆; 分叉数越大堆越浅, 下沉时每层比较的子节点越多
+// Fb 回调类型, 默认为不分配内存的 TimerCallback<T>
+template<class T, int D = 4, class Fb = TimerCallback<T>>
+class MinHeapTimer : public TimerBase<MinHeapTimer<T, D, Fb>, CallbackTimerNode<T, Fb>> {
+	using Base = TimerBase<MinHeapTimer, CallbackTimerNode<T, Fb>>;
+	friend Base;
+
+public:
+	using Callback = Fb;
+	using TNode = CallbackTimerNode<T, Fb>;
+	using Spec = TimerSpec<T, Fb>;
+
+	using Lock = typename Base::Lock;
+
+	// 批量添加时, 新节点数不少于堆中已有节点数的 1/HEAPIFY_RATIO 时改为整体建堆
+	static constexpr size_t HEAPIFY_RATIO = 1;
+
+	static_assert(D >= 2, "MinHeapTimer arity must be at least 2");
+
+	// 堆槽位, 内联存储过期时间, 堆调整时比较不需要访问 TimerNode
+	struct HeapEntry {
+		uint64_t expire_ms;  // 堆排序用的过期时间; 延迟调整时可能早于 node->expire_ms
+		TNode *node;         // 定时器节点
+	};
+
+	// resource 节点和最小堆使用的内存来源
+	explicit MinHeapTimer(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+			: Base(resource), _heap(resource) {
 		_heap.clear();
-		_map.clear();
 	}
 
 	virtual ~MinHeapTimer() {
+		for (auto &entry : _heap) {
+			_pool.Delete(entry.node);
+		}
 		_heap.clear();
-		_map.clear();
 	}
 
-	static inline int Count() {
-		return ++_count;
+	// 添加定时器节点, 节点数据为值初始化的 T
+	TimerId AddTimer(uint64_t timing_time_ms, Fb fb) {
+		return EmplaceTimer(timing_time_ms, std::move(fb), false);
 	}
 
-	// 添加定时器节点
-	int AddTimer(uint64_t timing_time_ms, std::function<void(struct TimerNode<T> *node)> &fb) {
-		std::unique_lock<std::mutex> lock(mtx_); // 加锁
-		T data;
-		memset(&data, 0, sizeof(T));
-		return _addTimer(timing_time_ms, data, fb);
+	// 添加定时器, 返回定时器 id; 定时器数量达到上限时返回 -1
+	// timing_time_ms 定时时间
+	// data      节点存储数据, 拷贝到节点中
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间, 最晚在过期时间 + slack_ms 触发, 其它定时器到期时一并触发, 见 TimerSlackExpire
+	TimerId AddTimer(uint64_t timing_time_ms, const T &data, Fb fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms, data);
+	}
+
+	// 添加定时器, data 移动到节点中
+	TimerId AddTimer(uint64_t timing_time_ms, T &&data, Fb fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms, std::move(data));
 	}
 
-	// 添加定时器
+	// 添加定时器, 节点数据为值初始化的 T
 	// timing_time_ms 定时时间
-	// T &data   节点存储数据
 	// fb        定时回调
 	// is_loop   是否循环定时
-	int AddTimer(uint64_t timing_time_ms, T &data, std::function<void(struct TimerNode<T> *node)> &fb, bool is_loop = false) {
-		std::unique_lock<std::mutex> lock(mtx_); // 加锁
-		return _addTimer(timing_time_ms, data, fb, is_loop);
+	// slack_ms  允许延后触发的时间
+	TimerId AddTimer(uint64_t timing_time_ms, Fb fb, bool is_loop, uint64_t slack_ms = 0) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms);
 	}
 
-	// 添加定时器
+	// 添加定时器, 以 args 在节点中直接构造 T, 不发生拷贝
 	// timing_time_ms 定时时间
 	// fb        定时回调
 	// is_loop   是否循环定时
-	int AddTimer(uint64_t timing_time_ms, std::function<void(struct TimerNode<T> *node)> &fb, bool is_loop) {
-		T data;
-		memset(&data, 0, sizeof(T));
+	// args      T 的构造参数
+	template<class... Args>
+	TimerId EmplaceTimer(uint64_t timing_time_ms, Fb fb, bool is_loop, Args &&...args) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, 0, std::forward<Args>(args)...);
+	}
+
+	// 批量添加定时器, 只加锁一次; 返回成功添加的数量
+	// 新节点较多时整体自底向上建堆 O(n), 否则逐个上浮
+	// specs     定时器参数, data 和 fb 被移动到节点中
+	// count     定时器数量
+	// ids       输出定时器 id, 长度为 count; 添加失败的位置为 -1
+	size_t AddTimers(Spec *specs, size_t count, TimerId *ids) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		if (count == 0) {
+			return 0;
+		}
 
-		std::unique_lock<std::mutex> lock(mtx_); // 加锁
-		return _addTimer(timing_time_ms, data, fb, is_loop);
+		uint64_t now = TimeUtils::CurrentTime_ms();
+		bool heapify = count * HEAPIFY_RATIO >= _heap.size();
+		uint64_t min_expire = UINT64_MAX;
+		size_t added = 0;
+
+		_heap.reserve(_heap.size() + count);
+		for (size_t i = 0; i < count; i++) {
+			TimerId id = _handles.Reserve();
+			ids[i] = id;
+			if (id < 0) {
+				continue;
+			}
+
+			auto &spec = specs[i];
+			auto *node = _newNode(id, now, spec.timing_time_ms, std::move(spec.fb), spec.is_loop, spec.slack_ms, std::move(spec.data));
+			uint64_t expire_ms = TimerSlackExpire(node);
+			if (heapify) {
+				node->idx = (int) _heap.size();
+				_heap.push_back({expire_ms, node});
+			} else {
+				_push(node);
+			}
+
+			if (expire_ms < min_expire) {
+				min_expire = expire_ms;
+			}
+			_trace(TimerTraceEvent::Add, id);
+			added++;
+		}
+
+		if (heapify) {
+			_heapify();
+		}
+
+		if (added > 0) {
+			_onTimerAdded(min_expire);
+			if (_stats) {
+				_stats->adds.fetch_add(added, std::memory_order_relaxed);
+				_stats->UpdatePeak(_heap.size());
+			}
+		}
+
+		return added;
 	}
 
 	// 删除节点
-	bool DelTimer(int id) {
-		bool is_lock = false;  // 尝试加锁
-		if (mtx_.try_lock()) {
-			is_lock = true;
-		}
+	// 已删除或已过期的 id 返回 false
+	bool DelTimer(TimerId id) {
+		auto lock = _lock(TimerLockSite::DelTimer); // 加锁
+		return _delTimer(id);
+	}
 
-		auto iter = _map.find(id);
-		if (iter == _map.end()) {
-			return false;
+	// 批量删除节点, 只加锁一次; 返回成功删除的数量
+	// 删除数量不少于堆大小的 compact_ratio 时, 先标记全部节点, 再一次性压缩并重建最小堆, 不再逐个调整
+	size_t DelTimers(const TimerId *ids, size_t count) {
+		auto lock = _lock(TimerLockSite::DelTimer); // 加锁
+		size_t deleted = 0;
+
+		if ((double) count < (double) _heap.size() * _compact_ratio) {
+			for (size_t i = 0; i < count; i++) {
+				if (_delTimer(ids[i])) {
+					deleted++;
+				}
+			}
+			return deleted;
 		}
 
-		_delNode(iter->second);
+		for (size_t i = 0; i < count; i++) {
+			auto *node = _handles.Find(ids[i]);
+			if (!node) {
+				continue;
+			}
+
+			if (node->firing > 0) {
+				_cancelNode(node);
+			} else {
+				node->cancelled.store(true);  // 标记, 压缩时释放
+				_handles.Free(node->id);
+			}
+			_trace(TimerTraceEvent::Cancel, ids[i]);
+			deleted++;
+		}
 
-		if (is_lock) {
-			mtx_.unlock();
+		if (_stats) {
+			_stats->cancels.fetch_add(deleted, std::memory_order_relaxed);
 		}
 
-		return true;
+		_compact();
+		return deleted;
+	}
+
+	// 重设定时时间, 过期时间 = 当前时间 + timing_time_ms, id 不变, 不重新分配节点
+	// 返回 false 表示 id 无效, 或节点正在等待/执行回调
+	bool ResetTimer(TimerId id, uint64_t timing_time_ms) {
+		auto lock = _lock(); // 加锁
+		return _resetTimer(id, timing_time_ms);
+	}
+
+	// 设置延迟调整模式
+	// 启用后 ResetTimer 推迟过期时间时不调整最小堆, 节点到达堆顶时再一次性下沉
+	void SetLazyReset(bool lazy) {
+		auto lock = _lock(); // 加锁
+		_lazy_reset = lazy;
+	}
+
+	// 设置压缩阈值, 默认 0.25
+	// 批量删除的数量不少于堆大小的 ratio, 或延迟删除模式下墓碑数量超过堆大小的 ratio 时, 压缩重建最小堆
+	void SetCompactRatio(double ratio) {
+		auto lock = _lock(); // 加锁
+		_compact_ratio = ratio;
+	}
+
+	// 设置延迟删除模式
+	// 启用后 DelTimer 只将节点标记为墓碑 (id 立即失效), 不调整最小堆; 墓碑到达堆顶时由 ExpireTimer 丢弃,
+	// 墓碑数量超过压缩阈值时整体压缩
+	void SetLazyDelete(bool lazy) {
+		auto lock = _lock(); // 加锁
+		_lazy_delete = lazy;
+		if (!lazy && _tombstones > 0) {
+			_compact();
+		}
 	}
 
 	// 查询最近过期节点, 并处理
 	void ExpireTimer() {
-		std::unique_lock<std::mutex> lock(mtx_); // 加锁
+		auto lock = _acquire(TimerLockSite::ExpireTimer); // 加锁
 		if (_heap.empty()) {
 			return;
 		}
+
 		uint64_t now = TimeUtils::CurrentTime_ms();
+		if (_expire_mode == TimerExpireMode::Unlocked) {
+			_expireUnlocked(lock, now);
+			return;
+		}
 
+		bool fired = false;
 		do {
-			auto *node = _heap.front();
-			if (now < node->expire_ms) {
+			if (!_frontExpired(now)) {
 				break;
 			}
+			auto *node = _heap.front().node;
+			fired = true;
 
 #ifdef DEBUG
 			for (int i = 0; i < _heap.size() && i % 733 == 0; i++) {
 #if 0
-				std::cout << "timer id : " << _heap[i]->id << ",   touch idx: " << _heap[i]->idx
-						  << ",   expire_ms: " << _heap[i]->expire_ms << ", timing_time_ms = " << _heap[i]->timing_time_ms << std::endl;
+				std::cout << "timer id : " << _heap[i].node->id << ",   touch idx: " << _heap[i].node->idx
+						  << ",   expire_ms: " << _heap[i].expire_ms << ", timing_time_ms = " << _heap[i].node->timing_time_ms << std::endl;
 #else
 				log_error("id : {}, heap tree size = {}, timing_time_ms: {}, block time = {} ms, ",
-				          _heap[i]->id, _heap.size(), _heap[i]->timing_time_ms, now - _heap[i]->expire_ms);
+				          _heap[i].node->id, _heap.size(), _heap[i].node->timing_time_ms, now - _heap[i].expire_ms);
 #endif
 			}
 #endif
 
-			if (node->fb) {
-				node->fb(node);
-			}
+			TimerPrepareFire(node, now);
+			node->firing++;
+			_callback_thread.store(std::this_thread::get_id());
+			InvokeTimerCallback(node, _stats.get(), _tracer);
+			_callback_thread.store(std::thread::id());
+			node->firing--;
 
 			// 如果是循环任务, 重新添加到定时器
-			if (!node->is_loop) {
+			if (node->cancelled.load()) {
+				_pool.Delete(node);  // 回调中已删除
+			} else if (!node->is_loop) {
 				_delNode(node);  // 删除任务和定时节点
 			} else {
-				_removeNode(node);  // 从最小堆中移除定时器节点
-				_addTimer(node);    // 重新添加到最小堆
+				_rearm(node, now);  // 原地调整到下一个周期
 			}
 
 		} while (!_heap.empty());
+
+		if (fired && _max_slack > 0) {
+			_fireEarly(now);  // 合并触发已到过期时间的节点
+		}
 	}
 
 	// 获取全部定时节点
 	size_t GetTimerNode(std::vector<TimerNode<T> *> &heap) {
 		heap.clear();
 
-		std::unique_lock<std::mutex> lock(mtx_); // 加锁
-		heap = _heap;
+		auto lock = _acquire(TimerLockSite::GetTimerNode); // 加锁
+		heap.reserve(_heap.size());
+		for (auto &entry : _heap) {
+			if (!entry.node->cancelled.load()) {
+				heap.push_back(entry.node);
+			}
+		}
 
 		return heap.size();
 	}
 
 
 protected:
+	// 最近的过期时间, 没有定时器时返回 UINT64_MAX; 需要持锁调用
+	uint64_t _nextExpire() const {
+		return _heap.empty() ? UINT64_MAX : _heap.front().expire_ms;
+	}
+
+	// 从最小堆中取出全部过期节点, 不执行回调; 需要持锁调用
+	// 取出的节点 firing 加 1, 回调结束后需要持锁调用 _finishExpired
+	void _takeExpired(uint64_t now, std::vector<TNode *> &out) {
+		size_t first = out.size();
+		while (_frontExpired(now)) {
+			auto *node = _heap.front().node;
+			_removeNode(node);
+			TimerPrepareFire(node, now);
+			node->firing++;
+			out.push_back(node);
+		}
+
+		if (out.size() > first && _max_slack > 0) {
+			_takeEarly(now, out);  // 合并触发已到过期时间的节点
+		}
+	}
+
+	// 取出已到过期时间、但未到最晚触发时间的全部节点, 不执行回调; 需要持锁调用
+	// 子节点的最晚触发时间不早于父节点, 超过 now + _max_slack 的子树中不会有已过期的节点, 不再向下查找
+	void _takeEarly(uint64_t now, std::vector<TNode *> &out) {
+		uint64_t limit = TimerSaturatingAdd(now, _max_slack);
+		size_t first = out.size();
+
+		_scan.clear();
+		if (!_heap.empty()) {
+			_scan.push_back(0);
+		}
+		while (!_scan.empty()) {
+			int pos = _scan.back();
+			_scan.pop_back();
+
+			auto &entry = _heap[pos];
+			if (entry.expire_ms > limit) {
+				continue;
+			}
+			if (!entry.node->cancelled.load() && entry.node->expire_ms <= now) {
+				out.push_back(entry.node);
+			}
+
+			int end = D * pos + 1 + D < (int) _heap.size() ? D * pos + 1 + D : (int) _heap.size();
+			for (int child = D * pos + 1; child < end; child++) {
+				_scan.push_back(child);
+			}
+		}
+
+		// 查找完再移出最小堆, 移除会改变其它节点的位置
+		for (size_t i = first; i < out.size(); i++) {
+			auto *node = out[i];
+			_removeNode(node);
+			TimerPrepareFire(node, now);
+			node->firing++;
+		}
+	}
+
+	// 回调结束后释放节点, 循环定时器重新加入最小堆; 需要持锁调用
+	void _finishExpired(TNode *node, uint64_t now) {
+		node->firing--;
+		if (node->cancelled.load()) {
+			_pool.Delete(node);  // 回调前/回调中已删除, 句柄已释放
+		} else if (!node->is_loop) {
+			_handles.Free(node->id);
+			_pool.Delete(node);
+		} else {
+			node->expire_ms = TimerNextPeriod(node, now);
+			_push(node);  // 重新添加到最小堆, id 不变
+			if (_stats) {
+				_stats->rearms.fetch_add(1, std::memory_order_relaxed);
+			}
+			_trace(TimerTraceEvent::Rearm, node->id);
+		}
+	}
+
 	inline bool _lessThan(int lhs, int rhs) {
-		return _heap[lhs]->expire_ms < _heap[rhs]->expire_ms;
+		return _heap[lhs].expire_ms < _heap[rhs].expire_ms;
+	}
+
+	// 将堆槽位写入 pos, 同步节点位置索引
+	inline void _place(int pos, const HeapEntry &entry) {
+		_heap[pos] = entry;
+		entry.node->idx = pos;
+	}
+
+	// 节点入堆
+	inline void _push(TNode *node) {
+		_heap.push_back({TimerSlackExpire(node), node});
+		_shiftUp((int) _heap.size() - 1);
 	}
 
 	// 添加定时器节点
 	// timing_time_ms 定时时间
-	// T &data   节点存储数据
 	// fb        定时回调
 	// is_loop   是否循环定时
-	virtual int _addTimer(uint64_t timing_time_ms, T &data, std::function<void(struct TimerNode<T> *node)> &fb, bool is_loop = false) {
-		int64_t timeout_ms = TimeUtils::CurrentTime_ms() + timing_time_ms;
+	// slack_ms  允许延后触发的时间
+	// args      节点数据 T 的构造参数
+	template<class... Args>
+	TimerId _addTimer(uint64_t timing_time_ms, Fb &&fb, bool is_loop, uint64_t slack_ms, Args &&...args) {
+		TimerId id = _handles.Reserve();
+		if (id < 0) {
+			return -1;
+		}
 
-		auto *node = new TNode();
-		int id = MinHeapTimer::Count();
+		return _addReservedTimer(id, timing_time_ms, std::move(fb), is_loop, slack_ms, std::forward<Args>(args)...);
+	}
 
-		node->id = id;                    // 定时器id
-		node->expire_ms = timeout_ms;     // 过期时间
-		node->timing_time_ms = timing_time_ms; // 定时时间
-		node->idx = (int) _heap.size();   // 最小堆节点位置索引
-		node->data = data;                // 存储数据
-		node->fb = fb;                    // 回调
-		node->is_loop = is_loop;          // 是否循环触发
+	// 使用预留的 id 添加定时器节点
+	template<class... Args>
+	TimerId _addReservedTimer(TimerId id, uint64_t timing_time_ms, Fb &&fb, bool is_loop, uint64_t slack_ms, Args &&...args) {
+		auto *node = _newNode(id, TimeUtils::CurrentTime_ms(), timing_time_ms, std::move(fb), is_loop, slack_ms, std::forward<Args>(args)...);
 
-		_heap.push_back(node);
-		_shiftUp((int) _heap.size() - 1);
-		_map.insert(std::make_pair(id, node));
+		_push(node);
+		_onTimerAdded(_heap[node->idx].expire_ms);
+		if (_stats) {
+			_stats->adds.fetch_add(1, std::memory_order_relaxed);
+			_stats->UpdatePeak(_heap.size());
+		}
+		_trace(TimerTraceEvent::Add, id);
 
 		return id;
 	}
 
-	int _addTimer(TNode *node) {
-		int64_t timeout_ms = TimeUtils::CurrentTime_ms() + node->timing_time_ms;
-		int id = MinHeapTimer::Count();
+	// 循环定时器进入下一个周期, 节点仍在最小堆中, 原地下沉, id 不变
+	void _rearm(TNode *node, uint64_t now) {
+		if (_stats) {
+			_stats->rearms.fetch_add(1, std::memory_order_relaxed);
+		}
+		_trace(TimerTraceEvent::Rearm, node->id);
 
-		node->id = id;                    // 定时器id
-		node->expire_ms = timeout_ms;     // 定时时间
-		node->idx = (int) _heap.size();   // 最小堆节点位置索引
+		node->expire_ms = TimerNextPeriod(node, now);
+		_heap[node->idx].expire_ms = TimerSlackExpire(node);
+		_shiftDown(node->idx);
+	}
 
-		_heap.push_back(node);
-		_shiftUp((int) _heap.size() - 1);
-		_map.insert(std::make_pair(id, node));
 
-		return id;
+	// 自底向上建堆, 从最后一个非叶子节点开始逐个下沉
+	// 少于 2 个节点时已是堆; 空堆时 (0 - 2) / D 截断为 0, 不能进入循环
+	void _heapify() {
+		if (_heap.size() < 2) {
+			return;
+		}
+
+		for (int i = ((int) _heap.size() - 2) / D; i >= 0; i--) {
+			_shiftDown(i);
+		}
+	}
+
+	// 整理堆顶: 丢弃墓碑节点, 下沉延迟调整的节点; 返回堆顶节点是否已过期
+	inline bool _frontExpired(uint64_t now) {
+		for (;;) {
+			_popTombstones();
+			if (_heap.empty() || now < _heap.front().expire_ms) {
+				return false;
+			}
+
+			auto &front = _heap.front();
+			if (front.expire_ms < front.node->expire_ms) {
+				front.expire_ms = TimerSlackExpire(front.node);
+				_shiftDown(0);
+				continue;
+			}
+
+			return true;
+		}
+	}
+
+	// 丢弃堆顶的墓碑节点
+	inline void _popTombstones() {
+		while (_tombstones > 0 && !_heap.empty() && _heap.front().node->cancelled.load()) {
+			auto *node = _heap.front().node;
+			_removeNode(node);
+			_pool.Delete(node);
+			_tombstones--;
+		}
 	}
 
+	// 移除并释放全部已标记删除的节点, 重建最小堆
+	void _compact() {
+		_tombstones = 0;
 
-	// 节点下降
+		size_t j = 0;
+		for (size_t i = 0; i < _heap.size(); i++) {
+			auto *node = _heap[i].node;
+			if (node->cancelled.load()) {
+				_pool.Delete(node);
+				continue;
+			}
+
+			node->idx = (int) j;
+			_heap[j++] = _heap[i];
+		}
+
+		_heap.resize(j);
+		_heapify();
+	}
+
+	// 节点下降, 返回节点是否发生了移动
 	bool _shiftDown(int pos) {
-		int last = (int) _heap.size() - 1;
+		int size = (int) _heap.size();
+		if (pos >= size) {
+			return false;  // 压缩后堆可能已为空
+		}
+
+		HeapEntry entry = _heap[pos];
 		int idx = pos;
 
 		for (;;) {
-			int left = 2 * idx + 1;
-			if ((left >= last) || (left < 0)) {
+			int first = D * idx + 1; // first child
+			if (first >= size) {
 				break;
 			}
 
-			int min = left; // left child
-			int right = left + 1;
-
-			if (right < last && !_lessThan(left, right)) {
-				min = right; // right child
+			int last = first + D < size ? first + D : size;
+			int min = first;
+			for (int child = first + 1; child < last; child++) {
+				if (_lessThan(child, min)) {
+					min = child;
+				}
 			}
 
-			if (!_lessThan(min, idx)) {
+			if (!(_heap[min].expire_ms < entry.expire_ms)) {
 				break;
 			}
 
-			std::swap(_heap[idx], _heap[min]);
-			_heap[idx]->idx = idx;
-			_heap[min]->idx = min;
+			_place(idx, _heap[min]);
 			idx = min;
 		}
 
+		_place(idx, entry);
 		return idx > pos;
 	}
 
 	// 节点上升
 	void _shiftUp(int pos) {
-		for (;;) {
-			int parent = (pos - 1) / 2; // parent node
-			if (parent == pos || !_lessThan(pos, parent)) {
+		HeapEntry entry = _heap[pos];
+
+		while (pos > 0) {
+			int parent = (pos - 1) / D; // parent node
+			if (!(entry.expire_ms < _heap[parent].expire_ms)) {
 				break;
 			}
 
-			std::swap(_heap[parent], _heap[pos]);
-			_heap[parent]->idx = parent;
-			_heap[pos]->idx = pos;
+			_place(pos, _heap[parent]);
 			pos = parent;
 		}
+
+		_place(pos, entry);
+	}
+
+	// 重设 id 对应节点的定时时间, 需要持锁调用
+	bool _resetTimer(TimerId id, uint64_t timing_time_ms) {
+		auto *node = _handles.Find(id);
+		if (!node || node->firing > 0) {
+			return false;
+		}
+
+		node->timing_time_ms = timing_time_ms;
+		node->expire_ms = TimeUtils::CurrentTime_ms() + timing_time_ms;
+		uint64_t expire_ms = TimerSlackExpire(node);
+
+		auto &entry = _heap[node->idx];
+		if (expire_ms < entry.expire_ms) {
+			entry.expire_ms = expire_ms;
+			_shiftUp(node->idx);
+			_onTimerAdded(expire_ms);
+		} else if (!_lazy_reset) {
+			entry.expire_ms = expire_ms;
+			_shiftDown(node->idx);
+		}
+		// 延迟调整: 堆中保留较早的过期时间, 节点到达堆顶时再按实际过期时间下沉
+		// 保留的过期时间不早于 node->expire_ms 时直接触发, 仍在容差窗口内
+
+		return true;
+	}
+
+	// 删除 id 对应的节点, 需要持锁调用
+	bool _delTimer(TimerId id) {
+		auto *node = _handles.Find(id);
+		if (node) {
+			_cancelNode(node);
+			if (_stats) {
+				_stats->cancels.fetch_add(1, std::memory_order_relaxed);
+			}
+			_trace(TimerTraceEvent::Cancel, id);
+		}
+
+		return node != nullptr;
 	}
 
 	// 删除节点
 	void _delNode(TNode *node) {
 		// 从最小堆中移除节点
 		_removeNode(node);
-		delete node;
+		_handles.Free(node->id);
+		_pool.Delete(node);
+	}
+
+	// 删除节点; 节点正在等待或执行回调时只做标记, 由过期处理释放
+	// 延迟删除模式下只标记节点, 节点到达堆顶或墓碑过多压缩时再释放
+	void _cancelNode(TNode *node) {
+		if (node->firing == 0) {
+			if (!_lazy_delete) {
+				_delNode(node);
+				return;
+			}
+
+			node->cancelled.store(true);
+			_handles.Free(node->id);
+			if ((double) ++_tombstones > (double) _heap.size() * _compact_ratio) {
+				_compact();
+			}
+			return;
+		}
+
+		node->cancelled.store(true);
+		if (node->idx >= 0) {
+			_removeNode(node);
+		}
+		_handles.Free(node->id);
 	}
 
 	// 从最小堆中移除节点
@@ -254,56 +1300,335 @@ protected:
 		int idx = node->idx;
 
 		if (idx != last) {
-			std::swap(_heap[idx], _heap[last]);
-			_heap[idx]->idx = idx;
+			_heap[idx] = _heap[last];
+			_heap.pop_back();
 
 			if (!_shiftDown(idx)) {
 				_shiftUp(idx);
 			}
+		} else {
+			_heap.pop_back();
 		}
 
-		_heap.pop_back();
-		_map.erase(node->id);
+		node->idx = -1;
 	}
 
 
 protected:
-	std::mutex mtx_;             // 互斥锁
-	std::vector<TNode *> _heap;  // 最小堆
-	std::map<int, TNode *> _map; // <TimerNode::id, 节点>
-
-	static int _count;  // 定时器节点数量
+	using Base::mtx_;
+	using Base::_pool;
+	using Base::_handles;
+	using Base::_expire_mode;
+	using Base::_callback_thread;
+	using Base::_stats;
+	using Base::_tracer;
+	using Base::_acquire;
+	using Base::_lock;
+	using Base::_trace;
+	using Base::_newNode;
+	using Base::_setCatchUp;
+	using Base::_onTimerAdded;
+	using Base::_expireUnlocked;
+	using Base::_fireEarly;
+	using Base::_max_slack;
+
+	std::pmr::vector<HeapEntry> _heap; // 最小堆
+	std::vector<int> _scan;            // _takeEarly 查找用的栈
+
+	double _compact_ratio = 0.25;      // 压缩阈值
+	bool _lazy_delete = false;         // 延迟删除模式
+	bool _lazy_reset = false;          // 延迟调整模式
+	size_t _tombstones = 0;            // 最小堆中的墓碑节点数量
 };
 
-template<class T>
-int MinHeapTimer<T>::_count = 0;
 
+// 有界无锁多生产者单消费者队列
+// 生产者通过 CAS 抢占槽位, 写入后发布序号; 消费者按槽位顺序取出, 不加锁
+template<class Cmd>
+class TimerCommandQueue {
+public:
+	// capacity 队列容量, 向上取整为 2 的幂
+	explicit TimerCommandQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
 
-template<class T>
-class MinHeapTimerLoop : public MinHeapTimer<T> {
+		_mask = size - 1;
+		_cells.reset(new Cell[size]);
+		for (size_t i = 0; i < size; i++) {
+			_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~TimerCommandQueue() {
+		Drain([](Cmd &) {
+		});
+	}
+
+	// 入队, 成功时 cmd 被移动到队列中, 队列满时返回 false; 多个生产者可并发调用
+	bool TryPush(Cmd &cmd) {
+		Cell *cell;
+		size_t pos = _tail.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+			if (diff == 0) {
+				if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		new(&cell->storage) Cmd(std::move(cmd));
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// 按入队顺序取出全部已发布的命令, 只能由消费者调用; 返回处理的命令数
+	template<class F>
+	size_t Drain(F &&f) {
+		size_t count = 0;
+		for (;;) {
+			Cell &cell = _cells[_head & _mask];
+			if (cell.seq.load(std::memory_order_acquire) != _head + 1) {
+				break;
+			}
+
+			Cmd *cmd = reinterpret_cast<Cmd *>(&cell.storage);
+			f(*cmd);
+			cmd->~Cmd();  // 释放回调等资源
+			cell.seq.store(_head + _mask + 1, std::memory_order_release);
+			_head++;
+			count++;
+		}
+		return count;
+	}
+
+	// 是否没有已发布的命令, 只能由消费者调用
+	inline bool Empty() const {
+		return _cells[_head & _mask].seq.load(std::memory_order_acquire) != _head + 1;
+	}
+
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;                                              // 槽位序号
+		typename std::aligned_storage<sizeof(Cmd), alignof(Cmd)>::type storage; // 命令, 入队时构造, 取出后析构
+	};
+
+	std::unique_ptr<Cell[]> _cells;
+	size_t _mask = 0;
+	alignas(64) std::atomic<size_t> _tail{0}; // 生产者位置
+	alignas(64) size_t _head = 0;             // 消费者位置
+};
+
+
+// 定时器循环线程
+// Timer 定时器实现, 默认为最小堆 MinHeapTimer<T>, 可替换为 TimingWheelTimer<T> 等接口相同的实现
+template<class T, class Timer = MinHeapTimer<T>>
+class MinHeapTimerLoop : public Timer {
 public:
-	MinHeapTimerLoop() {
+	using Callback = typename Timer::Callback;
+	using TNode = typename Timer::TNode;
+	using KeyExtractor = InplaceFunction<uint64_t(const T &data)>;
+
+	// args 转发给 Timer 的构造函数
+	template<class... Args>
+	explicit MinHeapTimerLoop(Args &&...args) : Timer(std::forward<Args>(args)...) {
 		is_running.store(false);
-		min_timing_time_ms.store(TIMER_LOOP_TIME);
 	}
 
 	~MinHeapTimerLoop() override {
 		if (is_running.load()) {
-			StartTimerLoop();
+			StopTimerLoop();
+		}
+	}
+
+	// 启用命令队列模式, 需要在 StartTimerLoop 和 AddTimer 之前调用
+	// 启用后 AddTimer/DelTimer/DelTimers/ResetTimer/SetCatchUp 只将命令写入无锁队列 (id 在调用线程中无锁分配),
+	// 不等待定时线程, 同一线程写入的命令按调用顺序执行; 定时线程在每次处理过期节点前批量执行队列中的命令;
+	// 此时这些接口的返回值只表示命令已写入, 不表示 id 有效, 命令执行的结果不返回给调用者
+	// capacity 队列容量, 队列满时调用线程让出 CPU 等待; 定时线程自身 (回调中) 或定时线程未运行时改为加锁直接执行
+	void EnableCommandQueue(size_t capacity = 65536) {
+		_queue.reset(new TimerCommandQueue<Command>(capacity));
+	}
+
+	// 启用回调线程池, 需要在 StartTimerLoop 之前调用
+	// 启用后定时线程只维护定时器, 过期节点的回调交给线程池并行执行, 回调结束后由定时线程释放节点或重新定时;
+	// 不同定时器的回调可能并发执行, 回调中可以调用 AddTimer/DelTimer
+	// threads  工作线程数量, 为 0 时使用 CPU 核数
+	void EnableDispatchPool(size_t threads = 0) {
+		_dispatcher.reset(new TimerDispatchPool(threads));
+	}
+
+	// 设置回调串行 key 的提取函数, 需要在 StartTimerLoop 之前调用
+	// 线程池模式下 key 相同的回调按过期顺序串行执行, key 不同的回调并行执行;
+	// 添加时指定了 key 的定时器以添加时的 key 为准
+	void SetKeyExtractor(KeyExtractor extractor) {
+		_key_extractor = std::move(extractor);
+	}
+
+	// 添加定时器, 指定回调串行 key; 返回定时器 id
+	// key       串行 key, 如传感器 id; 线程池模式下 key 相同的回调不会并发执行
+	TimerId AddTimerByKey(uint64_t key, uint64_t timing_time_ms, const T &data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		return _emplace(timing_time_ms, std::move(fb), is_loop, slack_ms, key, data);
+	}
+
+	// 添加定时器, 指定回调串行 key, data 移动到节点中
+	TimerId AddTimerByKey(uint64_t key, uint64_t timing_time_ms, T &&data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		return _emplace(timing_time_ms, std::move(fb), is_loop, slack_ms, key, std::move(data));
+	}
+
+	// 添加定时器节点, 节点数据为值初始化的 T
+	TimerId AddTimer(uint64_t timing_time_ms, Callback fb) {
+		return EmplaceTimer(timing_time_ms, std::move(fb), false);
+	}
+
+	// 添加定时器, 返回定时器 id; 定时器数量达到上限时返回 -1
+	// timing_time_ms 定时时间
+	// data      节点存储数据, 拷贝到节点中
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间, 最晚在过期时间 + slack_ms 触发, 其它定时器到期时一并触发, 见 TimerSlackExpire
+	TimerId AddTimer(uint64_t timing_time_ms, const T &data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		return _emplace(timing_time_ms, std::move(fb), is_loop, slack_ms, UINT64_MAX, data);
+	}
+
+	// 添加定时器, data 移动到节点中
+	TimerId AddTimer(uint64_t timing_time_ms, T &&data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		return _emplace(timing_time_ms, std::move(fb), is_loop, slack_ms, UINT64_MAX, std::move(data));
+	}
+
+	// 添加定时器, 节点数据为值初始化的 T
+	// timing_time_ms 定时时间
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间
+	TimerId AddTimer(uint64_t timing_time_ms, Callback fb, bool is_loop, uint64_t slack_ms = 0) {
+		return _emplace(timing_time_ms, std::move(fb), is_loop, slack_ms, UINT64_MAX);
+	}
+
+	// 添加定时器, 以 args 构造 T
+	// 命令队列模式下 T 先构造在命令中, 再移动到节点中
+	template<class... Args>
+	TimerId EmplaceTimer(uint64_t timing_time_ms, Callback fb, bool is_loop, Args &&...args) {
+		return _emplace(timing_time_ms, std::move(fb), is_loop, 0, UINT64_MAX, std::forward<Args>(args)...);
+	}
+
+
+	// 删除节点
+	// 命令队列模式下只写入删除命令, 返回 true
+	bool DelTimer(TimerId id) {
+		if (!_queue) {
+			return Timer::DelTimer(id);
+		}
+
+		Command cmd;
+		cmd.op = Command::DEL;
+		cmd.id = id;
+		_post(cmd);
+
+		return true;
+	}
+
+	// 批量删除节点
+	// 命令队列模式下逐个写入删除命令, 返回写入的命令数
+	size_t DelTimers(const TimerId *ids, size_t count) {
+		if (!_queue) {
+			return Timer::DelTimers(ids, count);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			DelTimer(ids[i]);
+		}
+		return count;
+	}
+
+	// 重设定时时间
+	// 命令队列模式下只写入命令, 返回 true; 过期时间以定时线程执行命令的时间为准
+	bool ResetTimer(TimerId id, uint64_t timing_time_ms) {
+		if (!_queue) {
+			return Timer::ResetTimer(id, timing_time_ms);
+		}
+
+		Command cmd;
+		cmd.op = Command::RESET;
+		cmd.id = id;
+		cmd.timing_time_ms = timing_time_ms;
+		_post(cmd);
+
+		return true;
+	}
+
+	// 设置循环定时器错过周期时的补偿策略
+	// 命令队列模式下只写入命令, 返回 true
+	bool SetCatchUp(TimerId id, TimerCatchUp policy, uint32_t burst_cap = 0) {
+		if (!_queue) {
+			return Timer::SetCatchUp(id, policy, burst_cap);
 		}
+
+		Command cmd;
+		cmd.op = Command::CATCH_UP;
+		cmd.id = id;
+		cmd.catch_up = policy;
+		cmd.burst_cap = burst_cap;
+		_post(cmd);
+
+		return true;
 	}
 
 	// 启动定时器
+	// 定时线程休眠到最近的过期时间, 添加了更早过期的定时器时提前唤醒
 	void StartTimerLoop() {
 		is_running.store(true);
 		log_info("StartTimerLoop");
 
-		thd = std::thread([&]() {
+		thd = std::thread([this]() {
+			_loop_thread.store(std::this_thread::get_id());
+			std::unique_lock<std::mutex> lock(this->mtx_);
 			while (is_running.load()) {
-				ExpireTimer();
-
-				// 轮询定时器任务的时间为最小定时时间的 1/10
-				std::this_thread::sleep_for(std::chrono::milliseconds(min_timing_time_ms.load() / 10));
+				_applyCommands();
+				_finishDispatched();
+
+				uint64_t next = this->_nextExpire();
+				uint64_t now = TimeUtils::CurrentTime_ms();
+
+				if (next > now) {
+					if (_queue || _dispatcher) {
+						// 先标记休眠再检查队列, 与生产者的 "先入队再检查休眠标记" 配合, 避免丢失唤醒
+						_sleeping.store(true);
+						std::atomic_thread_fence(std::memory_order_seq_cst);
+						if (_hasPending()) {
+							_sleeping.store(false);
+							continue;
+						}
+					}
+
+					_wake_ms = next;
+					if (next == UINT64_MAX) {
+						cv_.wait(lock);
+					} else {
+						cv_.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(next - now));
+					}
+					_wake_ms = 0;
+					_sleeping.store(false);
+					continue;
+				}
+
+				if (_dispatcher) {
+					_dispatchExpired(now);
+					continue;
+				}
+
+				lock.unlock();
+				this->ExpireTimer();
+				lock.lock();
 			}
 		});
 	}
@@ -312,44 +1637,223 @@ public:
 	void StopTimerLoop() {
 		log_info("StopTimerLoop Start.");
 
-		is_running.store(false);
+		{
+			std::unique_lock<std::mutex> lock(this->mtx_);
+			is_running.store(false);
+		}
+		cv_.notify_all();
+
 		if (thd.joinable()) {
 			thd.join();
 		}
 
+		if (_dispatcher) {
+			// 等待已分发的回调执行完成, 释放节点
+			_dispatcher->Wait();
+			std::unique_lock<std::mutex> lock(this->mtx_);
+			_finishDispatched();
+		}
+
 		log_info("StopTimerLoop Finish.");
 	}
 
 private:
-	// 添加定时器节点
-	// timing_time_ms 定时时间
-	// T &data   节点存储数据
-	// fb        定时回调
-	// is_loop   是否循环定时
-	int _addTimer(uint64_t timing_time_ms, T &data, std::function<void(struct TimerNode<T> *node)> &fb, bool is_loop = false) override {
-		int64_t timeout_ms = TimeUtils::CurrentTime_ms() + timing_time_ms;
+	// 添加定时器; 命令队列模式下预留 id 并写入添加命令
+	// key       回调串行 key, UINT64_MAX 表示未指定
+	template<class... Args>
+	TimerId _emplace(uint64_t timing_time_ms, Callback &&fb, bool is_loop, uint64_t slack_ms, uint64_t key, Args &&...args) {
+		if (!_queue) {
+			auto lock = this->_lock(TimerLockSite::AddTimer); // 加锁
+			TimerId id = this->_addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms, std::forward<Args>(args)...);
+			_setKey(id, key);
+			return id;
+		}
 
-		// 更新最小定时时间的10倍
-		if (min_timing_time_ms.load() > timing_time_ms) {
-			min_timing_time_ms.store(timing_time_ms);
+		TimerId id = this->_handles.Reserve();
+		if (id < 0) {
+			return -1;
 		}
 
-		auto *node = new TNode();
-		int id = MinHeapTimer::Count();
+		Command cmd;
+		cmd.op = Command::ADD;
+		cmd.id = id;
+		cmd.timing_time_ms = timing_time_ms;
+		cmd.data.emplace(std::forward<Args>(args)...);
+		cmd.fb = std::move(fb);
+		cmd.is_loop = is_loop;
+		cmd.slack_ms = slack_ms;
+		cmd.key = key;
+		_post(cmd);
 
-		node->id = id;                    // 定时器id
-		node->expire_ms = timeout_ms;     // 过期时间
-		node->timing_time_ms = timing_time_ms; // 定时时间
-		node->idx = (int) _heap.size();   // 最小堆节点位置索引
-		node->data = data;                // 存储数据
-		node->fb = fb;                    // 回调
-		node->is_loop = is_loop;          // 是否循环触发
+		return id;
+	}
 
-		_heap.push_back(node);
-		_shiftUp((int) _heap.size() - 1);
-		_map.insert(std::make_pair(id, node));
+	// 队列命令
+	struct Command {
+		enum Op {
+			ADD,
+			DEL,
+			RESET,
+			CATCH_UP,
+		};
+
+		Op op = ADD;
+		TimerId id = 0;
+		uint64_t timing_time_ms = 0;
+		std::optional<T> data;
+		Callback fb;
+		bool is_loop = false;
+		uint64_t slack_ms = 0;
+		uint64_t key = UINT64_MAX;
+		TimerCatchUp catch_up = TimerCatchUp::FireOnce;
+		uint32_t burst_cap = 0;
+	};
+
+	// 写入命令, 定时线程休眠时唤醒
+	// 队列满时等待定时线程取出命令; 调用者就是定时线程 (回调中), 或定时线程未运行时, 没有消费者会取出命令,
+	// 改为加锁先执行队列中已有的命令, 再直接执行本命令, 保持命令顺序
+	void _post(Command &cmd) {
+		while (!_queue->TryPush(cmd)) {
+			if (!is_running.load() || _loop_thread.load() == std::this_thread::get_id()) {
+				auto lock = this->_lock(); // 加锁; 持锁执行回调时不再加锁
+				_applyCommands();
+				_apply(cmd);
+				return;
+			}
 
-		return id;
+			_wake();
+			std::this_thread::yield();
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		_wake();
+	}
+
+	// 唤醒休眠的定时线程, 只有第一个发现休眠标记的生产者加锁
+	void _wake() {
+		if (_sleeping.load() && _sleeping.exchange(false)) {
+			std::unique_lock<std::mutex> lock(this->mtx_);
+			cv_.notify_one();
+		}
+	}
+
+	// 是否有待定时线程处理的命令或已执行完成的回调
+	bool _hasPending() {
+		if (_queue && !_queue->Empty()) {
+			return true;
+		}
+
+		std::unique_lock<std::mutex> lock(_done_mtx);
+		return !_done.empty();
+	}
+
+	// 取出过期节点交给线程池执行, 需要持锁调用
+	void _dispatchExpired(uint64_t now) {
+		this->_takeExpired(now, _taken);
+		for (auto *node : _taken) {
+			auto task = [this, node]() {
+				if (!node->cancelled.load()) {
+					InvokeTimerCallback(node, this->_stats.get(), this->_tracer);
+				}
+				_onDispatched(node);
+			};
+
+			uint64_t key = _keyOf(node);
+			if (key == UINT64_MAX) {
+				_dispatcher->Submit(task);
+			} else {
+				_dispatcher->Submit(key, task);  // 相同 key 的回调在同一线程中按序执行
+			}
+		}
+		_taken.clear();
+	}
+
+	// 回调执行完成, 在工作线程中调用; 节点交回定时线程处理
+	void _onDispatched(TNode *node) {
+		{
+			std::unique_lock<std::mutex> lock(_done_mtx);
+			_done.push_back(node);
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		_wake();
+	}
+
+	// 释放回调已执行完成的节点, 循环定时器重新定时; 需要持锁调用
+	void _finishDispatched() {
+		if (!_dispatcher) {
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(_done_mtx);
+			_finishing.swap(_done);
+		}
+
+		uint64_t now = TimeUtils::CurrentTime_ms();
+		for (auto *node : _finishing) {
+			this->_finishExpired(node, now);
+		}
+		_finishing.clear();
+	}
+
+	// 设置节点的回调串行 key, 需要持锁调用
+	void _setKey(TimerId id, uint64_t key) {
+		if (id < 0 || key == UINT64_MAX) {
+			return;
+		}
+
+		auto *node = this->_handles.Find(id);
+		if (node) {
+			node->key = key;
+		}
+	}
+
+	// 节点的回调串行 key, UINT64_MAX 表示不需要串行
+	uint64_t _keyOf(const TNode *node) {
+		if (node->key != UINT64_MAX) {
+			return node->key;
+		}
+
+		return _key_extractor ? _key_extractor(node->data) : UINT64_MAX;
+	}
+
+	// 批量执行队列中的命令, 需要持锁调用
+	void _applyCommands() {
+		if (!_queue) {
+			return;
+		}
+
+		_queue->Drain([this](Command &cmd) {
+			_apply(cmd);
+		});
+	}
+
+	// 执行命令, 需要持锁调用
+	void _apply(Command &cmd) {
+		switch (cmd.op) {
+			case Command::ADD:
+				this->_addReservedTimer(cmd.id, cmd.timing_time_ms, std::move(cmd.fb), cmd.is_loop, cmd.slack_ms, std::move(*cmd.data));
+				_setKey(cmd.id, cmd.key);
+				break;
+			case Command::DEL:
+				this->_delTimer(cmd.id);
+				break;
+			case Command::RESET:
+				this->_resetTimer(cmd.id, cmd.timing_time_ms);
+				break;
+			case Command::CATCH_UP:
+				this->_setCatchUp(cmd.id, cmd.catch_up, cmd.burst_cap);
+				break;
+		}
+	}
+
+	// 新节点早于定时线程的唤醒时间, 提前唤醒
+	void _onTimerAdded(uint64_t expire_ms) override {
+		if (expire_ms < _wake_ms) {
+			_wake_ms = 0;
+			cv_.notify_one();
+		}
 	}
 
 
@@ -357,7 +1861,19 @@ private:
 	// 线程
 	std::atomic_bool is_running;  // 运行标志位
 	std::thread thd;
-	std::atomic_int min_timing_time_ms; // 最小定时时间
+	std::condition_variable cv_;  // 定时线程休眠/唤醒, 与 mtx_ 配合使用
+	uint64_t _wake_ms = 0;        // 定时线程休眠的截止时间, 为 0 时表示未休眠; 受 mtx_ 保护
+
+	std::unique_ptr<TimerCommandQueue<Command>> _queue; // 命令队列, 为空时直接操作定时器
+	std::atomic_bool _sleeping{false};                   // 定时线程是否在休眠 (命令队列/线程池模式)
+	std::atomic<std::thread::id> _loop_thread{std::thread::id()}; // 定时线程, 即命令队列的消费者
+
+	std::unique_ptr<TimerDispatchPool> _dispatcher; // 回调线程池, 为空时在定时线程中执行回调
+	std::vector<TNode *> _taken;                    // 待分发的过期节点, 定时线程使用
+	std::mutex _done_mtx;                           // 保护 _done
+	std::vector<TNode *> _done;                     // 回调已执行完成的节点
+	std::vector<TNode *> _finishing;                // 正在释放的节点, 定时线程使用
+	KeyExtractor _key_extractor;                    // 回调串行 key 的提取函数
 };
 
 
@@ -0,0 +1,237 @@
+﻿#ifndef _SHARDEDMINHEAPTIMER_HPP
+#define _SHARDEDMINHEAPTIMER_HPP
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include "MinHeapTimer.hpp"
+
+
+// Timer 是否提供 AddTimerByKey (如 MinHeapTimerLoop)
+template<class Timer, class T, class = void>
+struct TimerHasAddByKey : std::false_type {
+};
+
+template<class Timer, class T>
+struct TimerHasAddByKey<Timer, T, std::void_t<decltype(std::declval<Timer &>().AddTimerByKey(
+		uint64_t(), uint64_t(), std::declval<const T &>(), std::declval<typename Timer::Callback>(), false, uint64_t()))>>
+		: std::true_type {
+};
+
+
+// 分片定时器
+// 持有多个相互独立的定时器 (每个分片一把锁), 添加时按线程或 key 选择分片, 不同分片的生产者互不竞争;
+// 分片下标作为 id 的实例标记, id 在全部分片中唯一, 删除时直接定位到所属分片; 回调中的 node->id 可直接使用
+// Timer 分片的定时器实现, 可以为 MinHeapTimerLoop<T>, 每个分片由自己的定时线程驱动
+template<class T, class Timer = MinHeapTimer<T>>
+class ShardedMinHeapTimer {
+public:
+	using Callback = typename Timer::Callback;
+
+	static constexpr size_t MAX_SHARDS = (size_t) TimerIdBits::TAG_MASK + 1;
+
+	// shard_count 分片数量, 为 0 时使用 CPU 核数, 最多 MAX_SHARDS 个
+	// args        转发给每个分片的构造函数
+	template<class... Args>
+	explicit ShardedMinHeapTimer(size_t shard_count = 0, Args &&...args) {
+		if (shard_count == 0) {
+			shard_count = std::thread::hardware_concurrency();
+		}
+		if (shard_count == 0) {
+			shard_count = 1;
+		}
+		if (shard_count > MAX_SHARDS) {
+			shard_count = MAX_SHARDS;
+		}
+
+		_shards.reserve(shard_count);
+		for (size_t i = 0; i < shard_count; i++) {
+			_shards.emplace_back(new Timer(args...));
+			_shards.back()->SetIdTag((uint32_t) i);
+		}
+	}
+
+	virtual ~ShardedMinHeapTimer() = default;
+
+	// 分片数量
+	inline size_t ShardCount() const {
+		return _shards.size();
+	}
+
+	// 获取分片
+	inline Timer &Shard(size_t shard) {
+		return *_shards[shard];
+	}
+
+	// id 所属分片
+	static inline size_t ShardOf(TimerId id) {
+		return (size_t) (id >> TimerIdBits::TAG_SHIFT);
+	}
+
+	// 添加定时器, 按当前线程选择分片; 失败时返回 -1
+	// timing_time_ms 定时时间
+	// T &data   节点存储数据
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间
+	TimerId AddTimer(uint64_t timing_time_ms, const T &data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		size_t shard = _threadShard();
+		return _shards[shard]->AddTimer(timing_time_ms, data, std::move(fb), is_loop, slack_ms);
+	}
+
+	// 添加定时器, data 移动到节点中
+	TimerId AddTimer(uint64_t timing_time_ms, T &&data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		size_t shard = _threadShard();
+		return _shards[shard]->AddTimer(timing_time_ms, std::move(data), std::move(fb), is_loop, slack_ms);
+	}
+
+	// 添加定时器, 以 args 在节点中直接构造 T
+	template<class... Args>
+	TimerId EmplaceTimer(uint64_t timing_time_ms, Callback fb, bool is_loop, Args &&...args) {
+		size_t shard = _threadShard();
+		return _shards[shard]->EmplaceTimer(timing_time_ms, std::move(fb), is_loop, std::forward<Args>(args)...);
+	}
+
+	// 添加定时器, 按当前线程选择分片, 节点数据为值初始化的 T
+	TimerId AddTimer(uint64_t timing_time_ms, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		size_t shard = _threadShard();
+		return _shards[shard]->AddTimer(timing_time_ms, std::move(fb), is_loop, slack_ms);
+	}
+
+	// 添加定时器, 按 key 选择分片, 相同 key 的定时器在同一分片中按序过期
+	// Timer 提供 AddTimerByKey 时 (如 MinHeapTimerLoop) key 同时作为分片内的回调串行 key, 否则只用于选择分片
+	// key       分片 key, 如传感器 id
+	TimerId AddTimerByKey(uint64_t key, uint64_t timing_time_ms, const T &data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		auto &timer = *_shards[(size_t) (key % _shards.size())];
+		if constexpr (TimerHasAddByKey<Timer, T>::value) {
+			return timer.AddTimerByKey(key, timing_time_ms, data, std::move(fb), is_loop, slack_ms);
+		} else {
+			return timer.AddTimer(timing_time_ms, data, std::move(fb), is_loop, slack_ms);
+		}
+	}
+
+	// 添加定时器, 按 key 选择分片, data 移动到节点中
+	TimerId AddTimerByKey(uint64_t key, uint64_t timing_time_ms, T &&data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		auto &timer = *_shards[(size_t) (key % _shards.size())];
+		if constexpr (TimerHasAddByKey<Timer, T>::value) {
+			return timer.AddTimerByKey(key, timing_time_ms, std::move(data), std::move(fb), is_loop, slack_ms);
+		} else {
+			return timer.AddTimer(timing_time_ms, std::move(data), std::move(fb), is_loop, slack_ms);
+		}
+	}
+
+	// 删除节点
+	bool DelTimer(TimerId id) {
+		if (id < 0) {
+			return false;
+		}
+
+		size_t shard = ShardOf(id);
+		if (shard >= _shards.size()) {
+			return false;
+		}
+
+		return _shards[shard]->DelTimer(id);
+	}
+
+	// 重设定时时间, id 不变
+	bool ResetTimer(TimerId id, uint64_t timing_time_ms) {
+		if (id < 0) {
+			return false;
+		}
+
+		size_t shard = ShardOf(id);
+		if (shard >= _shards.size()) {
+			return false;
+		}
+
+		return _shards[shard]->ResetTimer(id, timing_time_ms);
+	}
+
+	// 设置循环定时器错过周期时的补偿策略
+	bool SetCatchUp(TimerId id, TimerCatchUp policy, uint32_t burst_cap = 0) {
+		if (id < 0) {
+			return false;
+		}
+
+		size_t shard = ShardOf(id);
+		if (shard >= _shards.size()) {
+			return false;
+		}
+
+		return _shards[shard]->SetCatchUp(id, policy, burst_cap);
+	}
+
+	// 设置全部分片之后添加的定时器默认使用的补偿策略, 默认为 FireOnce, 见 TimerBase::SetDefaultCatchUp
+	void SetDefaultCatchUp(TimerCatchUp policy, uint32_t burst_cap = 0) {
+		for (auto &shard : _shards) {
+			shard->SetDefaultCatchUp(policy, burst_cap);
+		}
+	}
+
+	// 启用全部分片的运行统计, 通过 Shard(i).GetStats() 读取
+	void EnableStats() {
+		for (auto &shard : _shards) {
+			shard->EnableStats();
+		}
+	}
+
+	// 处理全部分片的过期节点
+	void ExpireTimer() {
+		for (auto &shard : _shards) {
+			shard->ExpireTimer();
+		}
+	}
+
+	// 处理指定分片的过期节点, 用于每个过期线程负责一个分片
+	void ExpireTimer(size_t shard) {
+		_shards[shard]->ExpireTimer();
+	}
+
+	// 启动全部分片的定时线程, Timer 为 MinHeapTimerLoop 时可用
+	void StartTimerLoop() {
+		for (auto &shard : _shards) {
+			shard->StartTimerLoop();
+		}
+	}
+
+	// 停止全部分片的定时线程
+	void StopTimerLoop() {
+		for (auto &shard : _shards) {
+			shard->StopTimerLoop();
+		}
+	}
+
+	// 获取全部定时节点
+	size_t GetTimerNode(std::vector<TimerNode<T> *> &heap) {
+		heap.clear();
+
+		std::vector<TimerNode<T> *> nodes;
+		for (auto &shard : _shards) {
+			shard->GetTimerNode(nodes);
+			heap.insert(heap.end(), nodes.begin(), nodes.end());
+		}
+
+		return heap.size();
+	}
+
+
+protected:
+	// 当前线程对应的分片, 线程首次调用时按顺序分配
+	inline size_t _threadShard() const {
+		static std::atomic<size_t> next_thread{0};
+		static thread_local size_t thread_index = next_thread.fetch_add(1);
+		return thread_index % _shards.size();
+	}
+
+
+protected:
+	std::vector<std::unique_ptr<Timer>> _shards; // 分片
+};
+
+
+#endif //_SHARDEDMINHEAPTIMER_HPP
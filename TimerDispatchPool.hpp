@@ -0,0 +1,215 @@
+﻿#ifndef _TIMERDISPATCHPOOL_HPP
+#define _TIMERDISPATCHPOOL_HPP
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <condition_variable>
+#include "InplaceFunction.hpp"
+
+
+// 定时回调线程池
+// 每个工作线程一个任务队列, 提交的任务轮流放入各队列; 工作线程优先执行自己队列头部的任务,
+// 自己的队列为空时从其他队列尾部窃取任务, 一次突发的大量过期回调可以分摊到全部线程
+// 按 key 提交的任务固定放入 key 对应线程的独占队列, 不会被窃取, 相同 key 的任务按提交顺序串行执行,
+// 不同 key 的任务并行执行, 不需要全局锁
+class TimerDispatchPool {
+public:
+	using Task = InplaceFunction<void()>;
+
+	// threads 工作线程数量, 为 0 时使用 CPU 核数
+	explicit TimerDispatchPool(size_t threads = 0) {
+		if (threads == 0) {
+			threads = std::thread::hardware_concurrency();
+		}
+		if (threads == 0) {
+			threads = 1;
+		}
+
+		_queues.reserve(threads);
+		for (size_t i = 0; i < threads; i++) {
+			_queues.emplace_back(new Queue());
+		}
+
+		_threads.reserve(threads);
+		for (size_t i = 0; i < threads; i++) {
+			_threads.emplace_back([this, i]() {
+				_run(i);
+			});
+		}
+	}
+
+	// 执行完全部已提交的任务后退出
+	~TimerDispatchPool() {
+		{
+			std::unique_lock<std::mutex> lock(_mtx);
+			_stop = true;
+			for (auto &queue : _queues) {
+				queue->cv.notify_one();
+			}
+		}
+
+		for (auto &thd : _threads) {
+			thd.join();
+		}
+	}
+
+	TimerDispatchPool(const TimerDispatchPool &) = delete;
+	TimerDispatchPool &operator=(const TimerDispatchPool &) = delete;
+
+	// 工作线程数量
+	inline size_t ThreadCount() const {
+		return _threads.size();
+	}
+
+	// 提交任务, 可以被任意工作线程执行
+	void Submit(Task task) {
+		size_t i = _next.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+		{
+			std::unique_lock<std::mutex> lock(_queues[i]->mtx);
+			_queues[i]->tasks.push_back(std::move(task));
+			_unfinished.fetch_add(1);
+			_stealable.fetch_add(1);  // 在队列锁内计数, 保证取出任务时计数不会先于提交减少
+		}
+
+		_notify(i, false);
+	}
+
+	// 按 key 提交任务, 相同 key 的任务在同一工作线程中按提交顺序执行
+	void Submit(uint64_t key, Task task) {
+		size_t i = (size_t) (key % _queues.size());
+		{
+			std::unique_lock<std::mutex> lock(_queues[i]->mtx);
+			_queues[i]->pinned.push_back(std::move(task));
+			_queues[i]->pinned_count.fetch_add(1);
+			_unfinished.fetch_add(1);
+		}
+
+		_notify(i, true);
+	}
+
+	// 等待已提交的任务全部执行完成
+	void Wait() {
+		while (_unfinished.load() > 0) {
+			std::this_thread::yield();
+		}
+	}
+
+
+private:
+	struct Queue {
+		std::mutex mtx;
+		std::deque<Task> tasks;                // 可被窃取的任务
+		std::deque<Task> pinned;               // 按 key 提交的任务, 只由本线程执行
+		std::atomic<size_t> pinned_count{0};   // pinned 中的任务数量
+		std::condition_variable cv;            // 与 TimerDispatchPool::_mtx 配合使用
+		bool idle = false;                     // 是否在等待, 受 TimerDispatchPool::_mtx 保护
+	};
+
+	// 唤醒空闲线程; 与工作线程的 "先标记空闲再检查任务数" 配合, 避免丢失唤醒
+	// i         任务所在的队列
+	// pinned    任务只能由第 i 个线程执行
+	void _notify(size_t i, bool pinned) {
+		if (_idle.load() == 0) {
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(_mtx);
+		if (_queues[i]->idle || pinned) {
+			_queues[i]->cv.notify_one();
+			return;
+		}
+
+		for (auto &queue : _queues) {
+			if (queue->idle) {
+				queue->cv.notify_one();
+				return;
+			}
+		}
+	}
+
+	// 从第 i 个队列头部取任务, 独占任务优先
+	bool _pop(size_t i, Task &task) {
+		auto &queue = *_queues[i];
+		std::unique_lock<std::mutex> lock(queue.mtx);
+		if (!queue.pinned.empty()) {
+			task = std::move(queue.pinned.front());
+			queue.pinned.pop_front();
+			queue.pinned_count.fetch_sub(1);
+			return true;
+		}
+
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			_stealable.fetch_sub(1);
+			return true;
+		}
+
+		return false;
+	}
+
+	// 从其他队列尾部窃取任务
+	bool _steal(size_t self, Task &task) {
+		for (size_t k = 1; k < _queues.size(); k++) {
+			auto &queue = *_queues[(self + k) % _queues.size()];
+			std::unique_lock<std::mutex> lock(queue.mtx, std::try_to_lock);
+			if (!lock.owns_lock() || queue.tasks.empty()) {
+				continue;
+			}
+
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			_stealable.fetch_sub(1);
+			return true;
+		}
+
+		return false;
+	}
+
+	// 工作线程
+	void _run(size_t self) {
+		auto &queue = *_queues[self];
+
+		for (;;) {
+			Task task;
+			if (_pop(self, task) || _steal(self, task)) {
+				task();
+				_unfinished.fetch_sub(1);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(_mtx);
+			queue.idle = true;
+			_idle.fetch_add(1);
+			queue.cv.wait(lock, [&]() {
+				return _stop || _stealable.load() > 0 || queue.pinned_count.load() > 0;
+			});
+			_idle.fetch_sub(1);
+			queue.idle = false;
+
+			if (_stop && _stealable.load() == 0 && queue.pinned_count.load() == 0) {
+				return;
+			}
+		}
+	}
+
+
+private:
+	std::vector<std::unique_ptr<Queue>> _queues; // 每个工作线程的任务队列
+	std::vector<std::thread> _threads;           // 工作线程
+	std::atomic<size_t> _next{0};                // 下一个任务放入的队列
+
+	std::atomic<size_t> _stealable{0};  // 可被窃取的任务数量
+	std::atomic<size_t> _unfinished{0}; // 已提交未执行完成的任务数量
+	std::atomic<size_t> _idle{0};       // 等待中的工作线程数量
+
+	std::mutex _mtx;    // 保护工作线程的空闲标记和停止标志
+	bool _stop = false; // 停止标志, 受 _mtx 保护
+};
+
+
+#endif //_TIMERDISPATCHPOOL_HPP
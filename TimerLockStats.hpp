@@ -0,0 +1,127 @@
+﻿#ifndef _TIMERLOCKSTATS_HPP
+#define _TIMERLOCKSTATS_HPP
+
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+
+// 加锁的入口
+enum class TimerLockSite {
+	AddTimer,     // AddTimer/AddTimers/EmplaceTimer
+	DelTimer,     // DelTimer/DelTimers
+	ExpireTimer,  // ExpireTimer
+	GetTimerNode, // GetTimerNode
+	Other,        // ResetTimer 及各设置接口
+	Count,
+};
+
+#ifdef TIMER_LOCK_STATS
+
+// 单个入口的锁统计, 全部为原子计数, 可以不加锁读取
+struct TimerLockCounters {
+	std::atomic<uint64_t> acquisitions{0}; // 加锁次数
+	std::atomic<uint64_t> contended{0};    // 需要等待的加锁次数
+	std::atomic<uint64_t> wait_ns{0};      // 等待锁的总时间, ns
+	std::atomic<uint64_t> hold_ns{0};      // 持锁的总时间, ns
+
+	void Reset() {
+		acquisitions.store(0, std::memory_order_relaxed);
+		contended.store(0, std::memory_order_relaxed);
+		wait_ns.store(0, std::memory_order_relaxed);
+		hold_ns.store(0, std::memory_order_relaxed);
+	}
+};
+
+// 按入口分类的锁统计
+struct TimerLockStats {
+	TimerLockCounters sites[(int) TimerLockSite::Count];
+
+	inline TimerLockCounters &operator[](TimerLockSite site) {
+		return sites[(int) site];
+	}
+
+	inline const TimerLockCounters &operator[](TimerLockSite site) const {
+		return sites[(int) site];
+	}
+
+	void Reset() {
+		for (auto &site : sites) {
+			site.Reset();
+		}
+	}
+};
+
+// 统计等待和持有时间的锁, 接口与 std::unique_lock<std::mutex> 相同
+// 先 try_lock, 失败时计为一次竞争并计时等待; 解锁时累加持锁时间
+class TimerStatsLock {
+public:
+	TimerStatsLock(std::mutex &mtx, TimerLockCounters &counters) : _lock(mtx, std::defer_lock), _counters(&counters) {
+		lock();
+	}
+
+	// 不加锁, 也不统计
+	TimerStatsLock(std::mutex &mtx, std::defer_lock_t) : _lock(mtx, std::defer_lock) {
+	}
+
+	TimerStatsLock(TimerStatsLock &&) = default;
+	TimerStatsLock &operator=(TimerStatsLock &&) = delete;
+
+	~TimerStatsLock() {
+		if (_lock.owns_lock()) {
+			unlock();
+		}
+	}
+
+	void lock() {
+		if (!_counters) {
+			_lock.lock();
+			return;
+		}
+
+		if (!_lock.try_lock()) {
+			auto start = std::chrono::steady_clock::now();
+			_lock.lock();
+			_acquired = std::chrono::steady_clock::now();
+			_counters->contended.fetch_add(1, std::memory_order_relaxed);
+			_counters->wait_ns.fetch_add(_elapsed_ns(start, _acquired), std::memory_order_relaxed);
+		} else {
+			_acquired = std::chrono::steady_clock::now();
+		}
+		_counters->acquisitions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void unlock() {
+		if (_counters) {
+			_counters->hold_ns.fetch_add(_elapsed_ns(_acquired, std::chrono::steady_clock::now()), std::memory_order_relaxed);
+		}
+		_lock.unlock();
+	}
+
+	inline bool owns_lock() const {
+		return _lock.owns_lock();
+	}
+
+
+private:
+	static inline uint64_t _elapsed_ns(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	}
+
+	std::unique_lock<std::mutex> _lock;
+	TimerLockCounters *_counters = nullptr;        // 为空时不统计
+	std::chrono::steady_clock::time_point _acquired; // 加锁时间
+};
+
+// 定时器 mtx_ 使用的锁
+using TimerLock = TimerStatsLock;
+
+#else
+
+using TimerLock = std::unique_lock<std::mutex>;
+
+#endif //TIMER_LOCK_STATS
+
+
+#endif //_TIMERLOCKSTATS_HPP
@@ -0,0 +1,162 @@
+﻿#ifndef _TIMERSTATS_HPP
+#define _TIMERSTATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+
+// 对数分桶直方图
+// 按 2 的幂分段, 每段再等分为 SUB_COUNT 个桶, 记录值的相对误差不超过 1/SUB_COUNT; 小于 SUB_COUNT 的值精确记录
+// 计数均为原子操作, 记录无锁, 可以在任意线程读取
+class TimerHistogram {
+public:
+	static constexpr int SUB_BITS = 3;
+	static constexpr int SUB_COUNT = 1 << SUB_BITS;
+	static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+	TimerHistogram() {
+		Reset();
+	}
+
+	TimerHistogram(const TimerHistogram &) = delete;
+	TimerHistogram &operator=(const TimerHistogram &) = delete;
+
+	// 记录一个值
+	void Record(uint64_t value) {
+		_buckets[_index(value)].fetch_add(1, std::memory_order_relaxed);
+		_count.fetch_add(1, std::memory_order_relaxed);
+		_sum.fetch_add(value, std::memory_order_relaxed);
+
+		uint64_t max = _max.load(std::memory_order_relaxed);
+		while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+		}
+	}
+
+	// 记录次数
+	inline uint64_t Count() const {
+		return _count.load(std::memory_order_relaxed);
+	}
+
+	// 最大值
+	inline uint64_t Max() const {
+		return _max.load(std::memory_order_relaxed);
+	}
+
+	// 平均值
+	double Mean() const {
+		uint64_t count = Count();
+		return count ? (double) _sum.load(std::memory_order_relaxed) / (double) count : 0.0;
+	}
+
+	// 百分位值, 返回所在桶的上界 (不超过最大值)
+	// percentile 百分位, [0, 100]
+	uint64_t Percentile(double percentile) const {
+		uint64_t count = Count();
+		if (count == 0) {
+			return 0;
+		}
+
+		uint64_t target = (uint64_t) ((double) count * percentile / 100.0);
+		if (target == 0) {
+			target = 1;
+		}
+
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKETS; i++) {
+			seen += _buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target) {
+				uint64_t upper = i + 1 < BUCKETS ? _lowerBound(i + 1) - 1 : UINT64_MAX;
+				uint64_t max = Max();
+				return upper < max ? upper : max;
+			}
+		}
+
+		return Max();
+	}
+
+	// 清空
+	void Reset() {
+		for (auto &bucket : _buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		_count.store(0, std::memory_order_relaxed);
+		_sum.store(0, std::memory_order_relaxed);
+		_max.store(0, std::memory_order_relaxed);
+	}
+
+
+private:
+	// 最高位下标
+	static inline int _msb(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+		return 63 - __builtin_clzll(value);
+#else
+		int msb = 0;
+		while (value >>= 1) {
+			msb++;
+		}
+		return msb;
+#endif
+	}
+
+	// 值所在的桶
+	static inline int _index(uint64_t value) {
+		if (value < (uint64_t) SUB_COUNT) {
+			return (int) value;
+		}
+
+		int shift = _msb(value) - SUB_BITS;
+		return (shift + 1) * SUB_COUNT + (int) ((value >> shift) & (SUB_COUNT - 1));
+	}
+
+	// 桶的下界
+	static inline uint64_t _lowerBound(int index) {
+		if (index < SUB_COUNT) {
+			return (uint64_t) index;
+		}
+
+		int shift = index / SUB_COUNT - 1;
+		return ((uint64_t) SUB_COUNT + (uint64_t) (index % SUB_COUNT)) << shift;
+	}
+
+	std::atomic<uint64_t> _buckets[BUCKETS]; // 各桶计数
+	std::atomic<uint64_t> _count;            // 记录次数
+	std::atomic<uint64_t> _sum;              // 记录值之和
+	std::atomic<uint64_t> _max;              // 最大值
+};
+
+
+// 定时器运行统计
+// 由定时器在持锁或执行回调时更新, 全部为原子计数, 其他线程可以不加锁读取
+struct TimerStats {
+	std::atomic<uint64_t> adds{0};      // 添加的定时器数量
+	std::atomic<uint64_t> cancels{0};   // 删除的定时器数量
+	std::atomic<uint64_t> fires{0};     // 触发次数
+	std::atomic<uint64_t> rearms{0};    // 循环定时器重新定时次数
+	std::atomic<size_t> peak_size{0};   // 同时存在的定时器数量峰值
+
+	TimerHistogram lateness_ms;         // 触发延迟 (回调开始时间 - 过期时间), ms
+	TimerHistogram callback_ns;         // 回调执行时间, ns
+
+	// 更新定时器数量峰值
+	void UpdatePeak(size_t size) {
+		size_t peak = peak_size.load(std::memory_order_relaxed);
+		while (size > peak && !peak_size.compare_exchange_weak(peak, size, std::memory_order_relaxed)) {
+		}
+	}
+
+	// 清空
+	void Reset() {
+		adds.store(0, std::memory_order_relaxed);
+		cancels.store(0, std::memory_order_relaxed);
+		fires.store(0, std::memory_order_relaxed);
+		rearms.store(0, std::memory_order_relaxed);
+		peak_size.store(0, std::memory_order_relaxed);
+		lateness_ms.Reset();
+		callback_ns.Reset();
+	}
+};
+
+
+#endif //_TIMERSTATS_HPP
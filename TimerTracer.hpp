@@ -0,0 +1,250 @@
+﻿#ifndef _TIMERTRACER_HPP
+#define _TIMERTRACER_HPP
+
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+// 定时器生命周期事件
+enum class TimerTraceEvent : uint8_t {
+	Add,    // 添加
+	Cancel, // 删除
+	Fire,   // 触发, 记录回调执行时间
+	Rearm,  // 循环定时器重新定时
+};
+
+// 定时器事件追踪
+// 每个线程写入自己的环形缓冲区, 写入无锁, 缓冲区写满后覆盖最旧的事件; 可以常驻开启
+// 时间戳在 x86 上为 TSC 计数 (要求 invariant TSC), 导出时按构造和导出时刻的 steady_clock 换算为 ns
+// 线程首次记录时加锁创建缓冲区; 同一线程交替写入多个追踪器时每次切换都会加锁查找
+class TimerTracer {
+public:
+	// capacity 每个线程保留的事件数量, 向上取整为 2 的幂
+	explicit TimerTracer(size_t capacity = 65536) {
+		_capacity = 1;
+		while (_capacity < capacity) {
+			_capacity <<= 1;
+		}
+
+		_start_ticks = Now();
+		_start_ns = _steadyNs();
+	}
+
+	TimerTracer(const TimerTracer &) = delete;
+	TimerTracer &operator=(const TimerTracer &) = delete;
+
+	// 当前时间戳, 单位由平台决定, 只用于 Record
+	static inline uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return _steadyNs();
+#endif
+	}
+
+	// 记录事件
+	// event     事件类型
+	// id        定时器 id
+	// ticks     事件开始时间戳, 由 Now() 获取
+	// duration  事件持续时间, 与 ticks 单位相同
+	void Record(TimerTraceEvent event, int64_t id, uint64_t ticks, uint64_t duration = 0) {
+		Buffer *buffer = _local();
+		uint64_t head = buffer->head.load(std::memory_order_relaxed);
+
+		auto &slot = buffer->slots[head & (_capacity - 1)];
+		slot.ticks.store(ticks, std::memory_order_relaxed);
+		slot.duration.store(duration, std::memory_order_relaxed);
+		slot.id.store(id, std::memory_order_relaxed);
+		slot.event.store((uint8_t) event, std::memory_order_relaxed);
+
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+
+	// 以当前时间记录事件
+	inline void Record(TimerTraceEvent event, int64_t id) {
+		Record(event, id, Now());
+	}
+
+	// 以 Chrome trace JSON 格式写入全部线程缓冲区中的事件, 可以用 chrome://tracing 或 Perfetto 打开
+	// 写入时其他线程可以继续记录, 导出期间被覆盖的事件会被丢弃
+	void WriteChromeTrace(std::FILE *file) {
+		double ns_per_tick = _nsPerTick();
+
+		std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+		bool first = true;
+
+		std::vector<Event> events;
+		std::unique_lock<std::mutex> lock(_mtx);
+		for (auto &buffer : _buffers) {
+			_snapshot(*buffer, events);
+
+			for (auto &event : events) {
+				double ts_us = _toUs(event.ticks, ns_per_tick);
+				const char *name = _eventName(event.event);
+				std::fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"timer\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,",
+				             first ? "" : ",", name, buffer->tid, ts_us);
+				if (event.event == (uint8_t) TimerTraceEvent::Fire) {
+					std::fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,", (double) event.duration * ns_per_tick / 1000.0);
+				} else {
+					std::fputs("\"ph\":\"i\",\"s\":\"t\",", file);
+				}
+				std::fprintf(file, "\"args\":{\"id\":%lld}}", (long long) event.id);
+				first = false;
+			}
+		}
+
+		std::fputs("\n]}\n", file);
+	}
+
+	// 导出到文件, 失败时返回 false
+	bool DumpChromeTrace(const char *path) {
+		std::FILE *file = std::fopen(path, "w");
+		if (!file) {
+			return false;
+		}
+
+		WriteChromeTrace(file);
+		return std::fclose(file) == 0;
+	}
+
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> ticks{0};
+		std::atomic<uint64_t> duration{0};
+		std::atomic<int64_t> id{0};
+		std::atomic<uint8_t> event{0};
+	};
+
+	// 单个线程的环形缓冲区, 只由所属线程写入
+	struct Buffer {
+		std::unique_ptr<Slot[]> slots;
+		std::atomic<uint64_t> head{0}; // 已写入的事件总数
+		std::thread::id owner;         // 所属线程
+		uint32_t tid = 0;              // 导出时的线程编号
+	};
+
+	// 导出时读出的事件
+	struct Event {
+		uint64_t ticks;
+		uint64_t duration;
+		int64_t id;
+		uint8_t event;
+	};
+
+	// 线程缓存的缓冲区
+	struct LocalCache {
+		uint64_t instance = 0;
+		Buffer *buffer = nullptr;
+	};
+
+	static inline uint64_t _steadyNs() {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static const char *_eventName(uint8_t event) {
+		switch ((TimerTraceEvent) event) {
+			case TimerTraceEvent::Add:
+				return "add";
+			case TimerTraceEvent::Cancel:
+				return "cancel";
+			case TimerTraceEvent::Fire:
+				return "fire";
+			default:
+				return "rearm";
+		}
+	}
+
+	// 当前线程的缓冲区
+	inline Buffer *_local() {
+		static thread_local LocalCache cache;
+		if (cache.instance != _instance) {
+			cache.buffer = _acquireBuffer();
+			cache.instance = _instance;
+		}
+		return cache.buffer;
+	}
+
+	// 查找或创建当前线程的缓冲区
+	Buffer *_acquireBuffer() {
+		std::unique_lock<std::mutex> lock(_mtx);
+		auto self = std::this_thread::get_id();
+		for (auto &buffer : _buffers) {
+			if (buffer->owner == self) {
+				return buffer.get();
+			}
+		}
+
+		auto *buffer = new Buffer();
+		buffer->slots.reset(new Slot[_capacity]);
+		buffer->owner = self;
+		buffer->tid = (uint32_t) _buffers.size() + 1;
+		_buffers.emplace_back(buffer);
+		return buffer;
+	}
+
+	// 读出缓冲区中仍有效的事件
+	void _snapshot(Buffer &buffer, std::vector<Event> &events) {
+		events.clear();
+
+		uint64_t head = buffer.head.load(std::memory_order_acquire);
+		uint64_t begin = head > _capacity ? head - _capacity : 0;
+		for (uint64_t i = begin; i < head; i++) {
+			auto &slot = buffer.slots[i & (_capacity - 1)];
+			events.push_back({slot.ticks.load(std::memory_order_relaxed), slot.duration.load(std::memory_order_relaxed),
+			                  slot.id.load(std::memory_order_relaxed), slot.event.load(std::memory_order_relaxed)});
+		}
+
+		// 读取期间写入线程可能已覆盖最旧的事件 (包括正在写入、尚未计入 head 的一个)
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t now_head = buffer.head.load(std::memory_order_relaxed);
+		if (now_head + 1 > begin + _capacity) {
+			uint64_t overwritten = now_head + 1 - _capacity - begin;
+			events.erase(events.begin(), events.begin() + (ptrdiff_t) std::min<uint64_t>(overwritten, events.size()));
+		}
+	}
+
+	// 时间戳单位换算为 ns 的比例
+	double _nsPerTick() const {
+		uint64_t ticks = Now();
+		uint64_t ns = _steadyNs();
+		if (ticks <= _start_ticks || ns <= _start_ns) {
+			return 1.0;
+		}
+		return (double) (ns - _start_ns) / (double) (ticks - _start_ticks);
+	}
+
+	inline double _toUs(uint64_t ticks, double ns_per_tick) const {
+		double offset = ((double) ticks - (double) _start_ticks) * ns_per_tick;
+		return ((double) _start_ns + offset) / 1000.0;
+	}
+
+	static inline uint64_t _nextInstance() {
+		static std::atomic<uint64_t> next{1};
+		return next.fetch_add(1);
+	}
+
+
+private:
+	const uint64_t _instance = _nextInstance(); // 实例编号, 用于区分线程缓存
+	size_t _capacity = 0;                        // 每个线程缓冲区的事件数量
+	uint64_t _start_ticks = 0;                   // 构造时的时间戳
+	uint64_t _start_ns = 0;                      // 构造时的 steady_clock, ns
+
+	std::mutex _mtx;                              // 保护 _buffers
+	std::vector<std::unique_ptr<Buffer>> _buffers; // 各线程的缓冲区
+};
+
+
+#endif //_TIMERTRACER_HPP
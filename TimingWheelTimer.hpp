@@ -0,0 +1,505 @@
+﻿#ifndef _TIMINGWHEELTIMER_HPP
+#define _TIMINGWHEELTIMER_HPP
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "MinHeapTimer.hpp"
+
+
+// 时间轮链表节点
+struct WheelLink {
+	WheelLink *prev = this;
+	WheelLink *next = this;
+
+	inline bool empty() const {
+		return next == this;
+	}
+
+	// 挂到链表尾部
+	inline void link(WheelLink *head) {
+		prev = head->prev;
+		next = head;
+		head->prev->next = this;
+		head->prev = this;
+	}
+
+	// 从链表中摘除
+	inline void unlink() {
+		prev->next = next;
+		next->prev = prev;
+		prev = next = this;
+	}
+};
+
+// 时间轮定时节点
+template<class T, class Fb>
+struct WheelTimerNode : public CallbackTimerNode<T, Fb>, public WheelLink {
+	using CallbackTimerNode<T, Fb>::CallbackTimerNode;
+};
+
+
+// 分层时间轮定时器, 接口与 MinHeapTimer 相同
+// 回调中可以重入调用 AddTimer/DelTimer/ResetTimer 等接口 (不会再次加锁); 也可以设置为 Unlocked 过期处理方式
+// 添加/删除 O(1), 过期处理均摊 O(1); 时间刻度为 1ms
+// 第 0 层 256 个槽位, 之后 4 层每层 64 个槽位, 共覆盖 2^32 ms
+// Fb 回调类型, 默认为不分配内存的 TimerCallback<T>
+template<class T, class Fb = TimerCallback<T>>
+class TimingWheelTimer : public TimerBase<TimingWheelTimer<T, Fb>, WheelTimerNode<T, Fb>> {
+	using Base = TimerBase<TimingWheelTimer, WheelTimerNode<T, Fb>>;
+	friend Base;
+
+public:
+	using Callback = Fb;
+	using TNode = WheelTimerNode<T, Fb>;
+	using Spec = TimerSpec<T, Fb>;
+	using Lock = typename Base::Lock;
+
+	static constexpr int NEAR_SHIFT = 8;
+	static constexpr int NEAR_SIZE = 1 << NEAR_SHIFT;
+	static constexpr uint64_t NEAR_MASK = NEAR_SIZE - 1;
+	static constexpr int LEVEL_SHIFT = 6;
+	static constexpr int LEVEL_SIZE = 1 << LEVEL_SHIFT;
+	static constexpr uint64_t LEVEL_MASK = LEVEL_SIZE - 1;
+	static constexpr int LEVEL_COUNT = 4;
+
+	// resource 节点使用的内存来源
+	explicit TimingWheelTimer(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+			: Base(resource) {
+		_current = TimeUtils::CurrentTime_ms();
+	}
+
+	virtual ~TimingWheelTimer() {
+		_handles.ForEach([this](TNode *node) {
+			_pool.Delete(node);
+		});
+	}
+
+	// 添加定时器节点, 节点数据为值初始化的 T
+	TimerId AddTimer(uint64_t timing_time_ms, Fb fb) {
+		return EmplaceTimer(timing_time_ms, std::move(fb), false);
+	}
+
+	// 添加定时器, 返回定时器 id; 定时器数量达到上限时返回 -1
+	// timing_time_ms 定时时间
+	// data      节点存储数据, 拷贝到节点中
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间, 按最晚触发时间挂到槽位; 其它定时器到期时, 第 0 层中已到过期时间的节点一并触发
+	TimerId AddTimer(uint64_t timing_time_ms, const T &data, Fb fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms, data);
+	}
+
+	// 添加定时器, data 移动到节点中
+	TimerId AddTimer(uint64_t timing_time_ms, T &&data, Fb fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms, std::move(data));
+	}
+
+	// 添加定时器, 节点数据为值初始化的 T
+	// timing_time_ms 定时时间
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间
+	TimerId AddTimer(uint64_t timing_time_ms, Fb fb, bool is_loop, uint64_t slack_ms = 0) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, slack_ms);
+	}
+
+	// 添加定时器, 以 args 在节点中直接构造 T, 不发生拷贝
+	// timing_time_ms 定时时间
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// args      T 的构造参数
+	template<class... Args>
+	TimerId EmplaceTimer(uint64_t timing_time_ms, Fb fb, bool is_loop, Args &&...args) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		return _addTimer(timing_time_ms, std::move(fb), is_loop, 0, std::forward<Args>(args)...);
+	}
+
+	// 批量添加定时器, 只加锁一次; 返回成功添加的数量
+	// specs     定时器参数, data 和 fb 被移动到节点中
+	// count     定时器数量
+	// ids       输出定时器 id, 长度为 count; 添加失败的位置为 -1
+	size_t AddTimers(Spec *specs, size_t count, TimerId *ids) {
+		auto lock = _lock(TimerLockSite::AddTimer); // 加锁
+		size_t added = 0;
+
+		for (size_t i = 0; i < count; i++) {
+			auto &spec = specs[i];
+			ids[i] = _addTimer(spec.timing_time_ms, std::move(spec.fb), spec.is_loop, spec.slack_ms, std::move(spec.data));
+			if (ids[i] >= 0) {
+				added++;
+			}
+		}
+
+		return added;
+	}
+
+	// 删除节点
+	// 已删除或已过期的 id 返回 false
+	bool DelTimer(TimerId id) {
+		auto lock = _lock(TimerLockSite::DelTimer); // 加锁
+		return _delTimer(id);
+	}
+
+	// 批量删除节点, 只加锁一次; 返回成功删除的数量
+	size_t DelTimers(const TimerId *ids, size_t count) {
+		auto lock = _lock(TimerLockSite::DelTimer); // 加锁
+		size_t deleted = 0;
+
+		for (size_t i = 0; i < count; i++) {
+			if (_delTimer(ids[i])) {
+				deleted++;
+			}
+		}
+		return deleted;
+	}
+
+	// 重设定时时间, 过期时间 = 当前时间 + timing_time_ms, id 不变
+	// 返回 false 表示 id 无效, 或节点正在执行回调
+	bool ResetTimer(TimerId id, uint64_t timing_time_ms) {
+		auto lock = _lock(); // 加锁
+		return _resetTimer(id, timing_time_ms);
+	}
+
+	// 推进时间轮, 处理全部过期节点
+	void ExpireTimer() {
+		auto lock = _acquire(TimerLockSite::ExpireTimer); // 加锁
+		uint64_t now = TimeUtils::CurrentTime_ms();
+
+		if (_expire_mode == TimerExpireMode::Unlocked) {
+			_expireUnlocked(lock, now);
+			return;
+		}
+
+		if (_handles.Size() == 0) {
+			// 没有定时器时直接跳到当前时间, 避免空转
+			if (now > _current) {
+				_current = now;
+			}
+			return;
+		}
+
+		bool fired = _execute(now);
+		while (_current < now) {
+			_shift();
+			if (_execute(now)) {
+				fired = true;
+			}
+		}
+
+		if (fired && _max_slack > 0) {
+			_fireEarly(now);  // 合并触发已到过期时间的节点
+		}
+	}
+
+	// 获取全部定时节点
+	size_t GetTimerNode(std::vector<TimerNode<T> *> &heap) {
+		heap.clear();
+
+		auto lock = _acquire(TimerLockSite::GetTimerNode); // 加锁
+		heap.reserve(_handles.Size());
+		_handles.ForEach([&](TNode *node) {
+			heap.push_back(node);
+		});
+
+		return heap.size();
+	}
+
+
+protected:
+	// 最近需要推进时间轮的时间, 没有定时器时返回 UINT64_MAX; 需要持锁调用
+	// 只检查第 0 层, 第 0 层为空时返回下一次级联的时间
+	uint64_t _nextExpire() const {
+		if (_handles.Size() == 0) {
+			return UINT64_MAX;
+		}
+
+		uint64_t end = (_current | NEAR_MASK) + 1;
+		for (uint64_t t = _current; t < end; t++) {
+			if (!_near[t & NEAR_MASK].empty()) {
+				return t;
+			}
+		}
+		return end;
+	}
+
+	// 添加定时器节点
+	// timing_time_ms 定时时间
+	// fb        定时回调
+	// is_loop   是否循环定时
+	// slack_ms  允许延后触发的时间
+	// args      节点数据 T 的构造参数
+	template<class... Args>
+	TimerId _addTimer(uint64_t timing_time_ms, Fb &&fb, bool is_loop, uint64_t slack_ms, Args &&...args) {
+		TimerId id = _handles.Reserve();
+		if (id < 0) {
+			return -1;
+		}
+
+		return _addReservedTimer(id, timing_time_ms, std::move(fb), is_loop, slack_ms, std::forward<Args>(args)...);
+	}
+
+	// 使用预留的 id 添加定时器节点
+	template<class... Args>
+	TimerId _addReservedTimer(TimerId id, uint64_t timing_time_ms, Fb &&fb, bool is_loop, uint64_t slack_ms, Args &&...args) {
+		uint64_t now = TimeUtils::CurrentTime_ms();
+		if (_handles.Size() == 0 && now > _current) {
+			// 空闲期间可能没有推进时间轮, 先跳到当前时间, 否则下次过期处理需要逐毫秒走完整个空闲期
+			_current = now;
+		}
+
+		auto *node = _newNode(id, now, timing_time_ms, std::move(fb), is_loop, slack_ms, std::forward<Args>(args)...);
+
+		_addNode(node);
+		_onTimerAdded(TimerSlackExpire(node));
+		if (_stats) {
+			_stats->adds.fetch_add(1, std::memory_order_relaxed);
+			_stats->UpdatePeak(_handles.Size());
+		}
+		_trace(TimerTraceEvent::Add, id);
+
+		return id;
+	}
+
+	// 重设 id 对应节点的定时时间, 需要持锁调用
+	bool _resetTimer(TimerId id, uint64_t timing_time_ms) {
+		auto *node = _handles.Find(id);
+		if (!node || node->firing > 0) {
+			return false;
+		}
+
+		node->unlink();
+		node->timing_time_ms = timing_time_ms;
+		node->expire_ms = TimeUtils::CurrentTime_ms() + timing_time_ms;
+		_addNode(node);
+		_onTimerAdded(TimerSlackExpire(node));
+
+		return true;
+	}
+
+	// 删除 id 对应的节点, 需要持锁调用
+	bool _delTimer(TimerId id) {
+		auto *node = _handles.Find(id);
+		if (!node) {
+			return false;
+		}
+
+		if (_stats) {
+			_stats->cancels.fetch_add(1, std::memory_order_relaxed);
+		}
+		_trace(TimerTraceEvent::Cancel, id);
+
+		if (node->firing > 0) {
+			// 正在等待或执行回调的节点, 回调结束后再释放
+			node->cancelled.store(true);
+			_handles.Free(id);
+		} else {
+			node->unlink();
+			_handles.Free(id);
+			_pool.Delete(node);
+		}
+
+		return true;
+	}
+
+	// 根据最晚触发时间将节点挂到对应层级的槽位
+	void _addNode(TNode *node) {
+		uint64_t expire = TimerSlackExpire(node);
+		if (expire < _current) {
+			expire = _current;  // 已过期的节点放到当前槽位, 下次推进时处理
+		}
+
+		if ((expire | NEAR_MASK) == (_current | NEAR_MASK)) {
+			node->link(&_near[expire & NEAR_MASK]);
+			return;
+		}
+
+		int i = 0;
+		uint64_t mask = (uint64_t) NEAR_SIZE << LEVEL_SHIFT;
+		for (; i < LEVEL_COUNT - 1; i++) {
+			if ((expire | (mask - 1)) == (_current | (mask - 1))) {
+				break;
+			}
+			mask <<= LEVEL_SHIFT;
+		}
+
+		// 超出覆盖范围的节点放到最高层, 级联时重新计算位置
+		int idx = (int) ((expire >> (NEAR_SHIFT + i * LEVEL_SHIFT)) & LEVEL_MASK);
+		node->link(&_level[i][idx]);
+	}
+
+	// 将高层槽位的节点重新分配到低层
+	void _cascade(int level, int idx) {
+		WheelLink list;
+		WheelLink *head = &_level[level][idx];
+		while (!head->empty()) {
+			WheelLink *link = head->next;
+			link->unlink();
+			link->link(&list);
+		}
+
+		while (!list.empty()) {
+			WheelLink *link = list.next;
+			link->unlink();
+			_addNode(static_cast<TNode *>(link));
+		}
+	}
+
+	// 时间前进 1ms
+	void _shift() {
+		uint64_t ct = ++_current;
+		uint64_t mask = NEAR_SIZE;
+		uint64_t time = ct >> NEAR_SHIFT;
+		int i = 0;
+
+		while ((ct & (mask - 1)) == 0) {
+			if (i == LEVEL_COUNT) {
+				_cascade(LEVEL_COUNT - 1, 0);
+				break;
+			}
+
+			int idx = (int) (time & LEVEL_MASK);
+			if (idx != 0) {
+				_cascade(i, idx);
+				break;
+			}
+
+			mask <<= LEVEL_SHIFT;
+			time >>= LEVEL_SHIFT;
+			i++;
+		}
+	}
+
+	// 执行当前槽位的全部节点, 返回是否有节点触发
+	// now       当前时间, 用于计算循环定时器错过的周期
+	bool _execute(uint64_t now) {
+		WheelLink *head = &_near[_current & NEAR_MASK];
+		bool fired = !head->empty();
+
+		while (!head->empty()) {
+			auto *node = static_cast<TNode *>(head->next);
+			node->unlink();
+
+			TimerPrepareFire(node, now);
+			node->firing++;
+			_callback_thread.store(std::this_thread::get_id());
+			InvokeTimerCallback(node, _stats.get(), _tracer);
+			_callback_thread.store(std::thread::id());
+			_finishExpired(node, now);
+		}
+
+		return fired;
+	}
+
+	// 推进时间轮并取出全部过期节点, 不执行回调; 需要持锁调用
+	// 取出的节点 firing 加 1, 回调结束后需要持锁调用 _finishExpired
+	void _takeExpired(uint64_t now, std::vector<TNode *> &out) {
+		if (_handles.Size() == 0) {
+			if (now > _current) {
+				_current = now;
+			}
+			return;
+		}
+
+		size_t first = out.size();
+		_take(now, out);
+		while (_current < now) {
+			_shift();
+			_take(now, out);
+		}
+
+		if (out.size() > first && _max_slack > 0) {
+			_takeEarly(now, out);  // 合并触发已到过期时间的节点
+		}
+	}
+
+	// 取出第 0 层中已到过期时间、但未到最晚触发时间的节点, 不执行回调; 需要持锁调用
+	// 只查找当前 256ms 周期内 _current + _max_slack 之前的槽位, 更高层的节点到最晚触发时间才触发
+	void _takeEarly(uint64_t now, std::vector<TNode *> &out) {
+		uint64_t end = TimerSaturatingAdd(_current, _max_slack);
+		if (end > (_current | NEAR_MASK)) {
+			end = _current | NEAR_MASK;
+		}
+
+		for (uint64_t t = _current + 1; t <= end; t++) {
+			WheelLink *head = &_near[t & NEAR_MASK];
+			for (WheelLink *link = head->next; link != head;) {
+				auto *node = static_cast<TNode *>(link);
+				link = link->next;
+				if (node->expire_ms > now) {
+					continue;
+				}
+
+				node->unlink();
+				TimerPrepareFire(node, now);
+				node->firing++;
+				out.push_back(node);
+			}
+		}
+	}
+
+	// 取出当前槽位的全部节点
+	void _take(uint64_t now, std::vector<TNode *> &out) {
+		WheelLink *head = &_near[_current & NEAR_MASK];
+
+		while (!head->empty()) {
+			auto *node = static_cast<TNode *>(head->next);
+			node->unlink();
+
+			TimerPrepareFire(node, now);
+			node->firing++;
+			out.push_back(node);
+		}
+	}
+
+	// 回调结束后释放节点, 循环定时器重新挂到时间轮; 需要持锁调用
+	void _finishExpired(TNode *node, uint64_t now) {
+		node->firing--;
+
+		// 如果是循环任务, 重新添加到定时器
+		if (node->cancelled.load()) {
+			_pool.Delete(node);  // 回调前/回调中已删除, 句柄已释放
+		} else if (!node->is_loop) {
+			_handles.Free(node->id);
+			_pool.Delete(node);
+		} else {
+			// Burst 补发时下一周期可能已过期, 挂到当前槽位由下次处理取出; 过期时间每次至少推进 1ms
+			node->expire_ms = TimerNextPeriod(node, now);
+			_addNode(node);
+			if (_stats) {
+				_stats->rearms.fetch_add(1, std::memory_order_relaxed);
+			}
+			_trace(TimerTraceEvent::Rearm, node->id);
+		}
+	}
+
+
+protected:
+	using Base::mtx_;
+	using Base::_pool;
+	using Base::_handles;
+	using Base::_expire_mode;
+	using Base::_callback_thread;
+	using Base::_stats;
+	using Base::_tracer;
+	using Base::_acquire;
+	using Base::_lock;
+	using Base::_trace;
+	using Base::_newNode;
+	using Base::_setCatchUp;
+	using Base::_onTimerAdded;
+	using Base::_expireUnlocked;
+	using Base::_fireEarly;
+	using Base::_max_slack;
+
+	WheelLink _near[NEAR_SIZE];              // 第 0 层槽位
+	WheelLink _level[LEVEL_COUNT][LEVEL_SIZE]; // 高层槽位
+	uint64_t _current = 0;                   // 当前时间刻度, ms
+};
+
+
+#endif //_TIMINGWHEELTIMER_HPP
@@ -0,0 +1,438 @@
+﻿// MinHeapTimer 微基准测试
+// 在不同堆大小和过期时间分布下测量 AddTimer/DelTimer/ExpireTimer/ResetTimer 及循环定时器重新定时的
+// 每次操作耗时 (ns/op) 与内存分配次数 (allocs/op), 每个结果输出一行 JSON, 便于回归对比
+//
+// 用法: timer_bench [--min N] [--max N] [--ops N] [--dist uniform|monotonic|bursty] [--bench name]
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include "MinHeapTimer.hpp"
+
+
+// 统计全局内存分配次数
+// 需要替换全部 operator new 重载: std::pmr::get_default_resource() 经由对齐版本 operator new 分配,
+// 只替换普通版本时内存池和最小堆的扩容不会被统计
+static std::atomic<uint64_t> g_allocs{0};
+
+static void *CountedAlloc(size_t size, size_t align) {
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0) {
+		size = 1;
+	}
+	if (align <= alignof(std::max_align_t)) {
+		return std::malloc(size);
+	}
+
+	void *p = nullptr;
+	return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+void *operator new(size_t size) {
+	if (void *p = CountedAlloc(size, alignof(std::max_align_t))) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+	if (void *p = CountedAlloc(size, (size_t) align)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+	return operator new(size, align);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return CountedAlloc(size, alignof(std::max_align_t));
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return CountedAlloc(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+	return CountedAlloc(size, (size_t) align);
+}
+
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+	return CountedAlloc(size, (size_t) align);
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+
+using Timer = MinHeapTimer<int>;
+
+// 过期时间分布
+enum class Dist {
+	Uniform,   // 均匀分布
+	Monotonic, // 单调递增
+	Bursty,    // 集中在少量时间点
+};
+
+static const char *DistName(Dist dist) {
+	switch (dist) {
+		case Dist::Uniform:
+			return "uniform";
+		case Dist::Monotonic:
+			return "monotonic";
+		default:
+			return "bursty";
+	}
+}
+
+// 按分布生成定时时间
+class DeadlineGen {
+public:
+	static constexpr int BURSTS = 64; // bursty 分布的时间点数量
+
+	// base      最小定时时间
+	// span      定时时间范围
+	// count     将要生成的数量, monotonic 分布按此均分范围
+	DeadlineGen(Dist dist, uint64_t base, uint64_t span, size_t count, uint32_t seed)
+			: _dist(dist), _base(base), _span(span ? span : 1), _count(count ? count : 1), _rng(seed) {
+	}
+
+	uint64_t Next() {
+		switch (_dist) {
+			case Dist::Uniform:
+				return _base + _rng() % _span;
+			case Dist::Monotonic:
+				return _base + _span * (_i++ % _count) / _count;
+			default:
+				return _base + _span * (_rng() % BURSTS) / BURSTS;
+		}
+	}
+
+private:
+	Dist _dist;
+	uint64_t _base;
+	uint64_t _span;
+	uint64_t _count;
+	uint64_t _i = 0;
+	std::mt19937_64 _rng;
+};
+
+static constexpr uint64_t FAR_MS = 1000000000; // 预填充定时器的定时时间下限, 测试期间不会过期
+static constexpr uint64_t FAR_SPAN = 1000000000;
+
+// 向定时器预填充 size 个不会过期的定时器, 返回 id
+static std::vector<TimerId> Prefill(Timer &timer, size_t size, Dist dist) {
+	DeadlineGen gen(dist, FAR_MS, FAR_SPAN, size, 1);
+	std::vector<Timer::Spec> specs(size);
+	for (auto &spec : specs) {
+		spec.timing_time_ms = gen.Next();
+		spec.fb = [](TimerNode<int> *) {
+		};
+	}
+
+	std::vector<TimerId> ids(size);
+	timer.AddTimers(specs.data(), specs.size(), ids.data());
+	return ids;
+}
+
+// 单次测量结果
+struct Result {
+	uint64_t ns = 0;
+	uint64_t allocs = 0;
+	size_t ops = 0;
+};
+
+// 测量 f 执行 ops 次操作的耗时和内存分配次数
+static Result Measure(size_t ops, const std::function<void()> &f) {
+	Result result;
+	result.ops = ops;
+
+	uint64_t allocs = g_allocs.load();
+	auto start = std::chrono::steady_clock::now();
+	f();
+	auto end = std::chrono::steady_clock::now();
+
+	result.ns = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	result.allocs = g_allocs.load() - allocs;
+	return result;
+}
+
+static void Report(const char *bench, Dist dist, size_t size, const Result &result) {
+	double ops = result.ops ? (double) result.ops : 1.0;
+	std::printf("{\"bench\":\"%s\",\"dist\":\"%s\",\"size\":%zu,\"ops\":%zu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.4f}\n",
+	            bench, DistName(dist), size, result.ops, (double) result.ns / ops, (double) result.allocs / ops);
+	std::fflush(stdout);
+}
+
+// 堆大小为 size 时添加 ops 个定时器
+static Result BenchInsert(size_t size, size_t ops, Dist dist) {
+	Timer timer;
+	Prefill(timer, size, dist);
+
+	DeadlineGen gen(dist, FAR_MS, FAR_SPAN, ops, 2);
+	std::vector<uint64_t> timings(ops);
+	for (auto &timing : timings) {
+		timing = gen.Next();
+	}
+
+	return Measure(ops, [&]() {
+		for (auto timing : timings) {
+			timer.AddTimer(timing, 0, [](TimerNode<int> *) {
+			});
+		}
+	});
+}
+
+// 堆大小为 size 时随机删除 ops 个定时器
+static Result BenchCancel(size_t size, size_t ops, Dist dist) {
+	Timer timer;
+	auto ids = Prefill(timer, size, dist);
+
+	std::mt19937_64 rng(3);
+	std::shuffle(ids.begin(), ids.end(), rng);
+	ids.resize(std::min(ops, ids.size()));
+
+	return Measure(ids.size(), [&]() {
+		for (auto id : ids) {
+			timer.DelTimer(id);
+		}
+	});
+}
+
+// 堆大小为 size 时随机重设 ops 次定时时间
+static Result BenchReset(size_t size, size_t ops, Dist dist) {
+	Timer timer;
+	auto ids = Prefill(timer, size, dist);
+
+	std::mt19937_64 rng(4);
+	DeadlineGen gen(dist, FAR_MS, FAR_SPAN, ops, 5);
+	std::vector<std::pair<TimerId, uint64_t>> resets(ops);
+	for (auto &reset : resets) {
+		reset.first = ids[rng() % ids.size()];
+		reset.second = gen.Next();
+	}
+
+	return Measure(ops, [&]() {
+		for (auto &reset : resets) {
+			timer.ResetTimer(reset.first, reset.second);
+		}
+	});
+}
+
+// 堆大小为 size 时一次过期处理 ops 个定时器
+// is_loop   为 true 时测量循环定时器的触发和重新定时
+static Result BenchFire(size_t size, size_t ops, Dist dist, bool is_loop) {
+	Timer timer;
+	Prefill(timer, size, dist);
+
+	// 过期时间分布在 [1, 5) ms 内, 等待全部过期后一次处理
+	// 循环定时器跳过错过的周期, 每个只触发一次并重新定时
+	timer.SetDefaultCatchUp(TimerCatchUp::Skip);
+	DeadlineGen gen(dist, 1, 4, ops, 6);
+	for (size_t i = 0; i < ops; i++) {
+		timer.AddTimer(gen.Next(), 0, [](TimerNode<int> *) {
+		}, is_loop);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+	return Measure(ops, [&]() {
+		timer.ExpireTimer();
+	});
+}
+
+// 校验基准结束后定时器中的节点数量, 不符时输出错误并退出; 不使用 assert, Release 构建同样生效
+static void ExpectTimers(Timer &timer, size_t expected, const char *bench) {
+	std::vector<TimerNode<int> *> nodes;
+	size_t count = timer.GetTimerNode(nodes);
+	if (count != expected) {
+		std::fprintf(stderr, "%s: expected %zu timers, found %zu\n", bench, expected, count);
+		std::exit(2);
+	}
+}
+
+// 堆大小为 size 时用一次 DelTimers 删除全部定时器, 再添加 ops 个定时器
+// 覆盖全部节点被删除、压缩后堆为空再继续使用的情况, 结束后校验只剩新添加的定时器
+static Result BenchDrain(size_t size, size_t ops, Dist dist) {
+	Timer timer;
+	auto ids = Prefill(timer, size, dist);
+
+	DeadlineGen gen(dist, FAR_MS, FAR_SPAN, ops, 7);
+	std::vector<uint64_t> timings(ops);
+	for (auto &timing : timings) {
+		timing = gen.Next();
+	}
+
+	Result result = Measure(ids.size() + ops, [&]() {
+		timer.DelTimers(ids.data(), ids.size());
+		for (auto timing : timings) {
+			timer.AddTimer(timing, 0, [](TimerNode<int> *) {
+			});
+		}
+	});
+
+	ExpectTimers(timer, ops, "drain");
+	return result;
+}
+
+// 延迟删除模式下逐个 DelTimer 删除全部定时器, 再添加 ops 个定时器
+// 墓碑数量超过阈值时压缩, 最后一次压缩后堆为空; 结束后在计时之外关闭延迟删除, 清理剩余墓碑并校验
+static Result BenchDrainLazy(size_t size, size_t ops, Dist dist) {
+	Timer timer;
+	timer.SetLazyDelete(true);
+	auto ids = Prefill(timer, size, dist);
+
+	DeadlineGen gen(dist, FAR_MS, FAR_SPAN, ops, 8);
+	std::vector<uint64_t> timings(ops);
+	for (auto &timing : timings) {
+		timing = gen.Next();
+	}
+
+	Result result = Measure(ids.size() + ops, [&]() {
+		for (auto id : ids) {
+			timer.DelTimer(id);
+		}
+		for (auto timing : timings) {
+			timer.AddTimer(timing, 0, [](TimerNode<int> *) {
+			});
+		}
+	});
+
+	timer.SetLazyDelete(false);
+	ExpectTimers(timer, ops, "drain-lazy");
+	return result;
+}
+
+static size_t ParseSize(const char *arg) {
+	return (size_t) std::strtod(arg, nullptr);
+}
+
+int main(int argc, char **argv) {
+	size_t min_size = 1000;
+	size_t max_size = 10000000;
+	size_t max_ops = 100000;
+	std::vector<Dist> dists = {Dist::Uniform, Dist::Monotonic, Dist::Bursty};
+	std::string only;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (std::strcmp(argv[i], "--min") == 0) {
+			min_size = ParseSize(argv[i + 1]);
+		} else if (std::strcmp(argv[i], "--max") == 0) {
+			max_size = ParseSize(argv[i + 1]);
+		} else if (std::strcmp(argv[i], "--ops") == 0) {
+			max_ops = ParseSize(argv[i + 1]);
+		} else if (std::strcmp(argv[i], "--bench") == 0) {
+			only = argv[i + 1];
+		} else if (std::strcmp(argv[i], "--dist") == 0) {
+			std::string name = argv[i + 1];
+			dists.clear();
+			if (name == "uniform") {
+				dists.push_back(Dist::Uniform);
+			} else if (name == "monotonic") {
+				dists.push_back(Dist::Monotonic);
+			} else {
+				dists.push_back(Dist::Bursty);
+			}
+		} else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (min_size == 0 || min_size > max_size) {
+		std::fprintf(stderr, "--min must be at least 1 and not greater than --max\n");
+		return 1;
+	}
+
+	for (size_t size = min_size; size <= max_size; size *= 10) {
+		size_t ops = std::min(size, max_ops);
+		for (auto dist : dists) {
+			if (only.empty() || only == "insert") {
+				Report("insert", dist, size, BenchInsert(size, ops, dist));
+			}
+			if (only.empty() || only == "cancel") {
+				Report("cancel", dist, size, BenchCancel(size, ops, dist));
+			}
+			if (only.empty() || only == "reset") {
+				Report("reset", dist, size, BenchReset(size, ops, dist));
+			}
+			if (only.empty() || only == "drain") {
+				Report("drain", dist, size, BenchDrain(size, ops, dist));
+			}
+			if (only.empty() || only == "drain-lazy") {
+				Report("drain-lazy", dist, size, BenchDrainLazy(size, ops, dist));
+			}
+			if (only.empty() || only == "fire") {
+				Report("fire", dist, size, BenchFire(size, ops, dist, false));
+			}
+			if (only.empty() || only == "rearm") {
+				Report("rearm", dist, size, BenchFire(size, ops, dist, true));
+			}
+		}
+
+		if (size > max_size / 10) {
+			break;  // 下一个规模超过 --max, 同时避免乘 10 溢出
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,235 @@
+﻿#ifndef _TIMER_TRACE_HPP
+#define _TIMER_TRACE_HPP
+
+// 定时器操作轨迹的记录与读取
+// 记录 AddTimer/AddTimerByKey/DelTimer 的调用时间和参数, 用于把线上采集的调用序列回放到任意定时器实现
+//
+// 文件格式为文本, 每行一个操作, 时间为相对记录开始的微秒数:
+//   <offset_us> add <id> <timing_ms> <is_loop> <slack_ms> <key>
+//   <offset_us> del <id>
+// id 为记录时的定时器 id, 只用于关联 add 和 del, 回放时重新分配;
+// key 为 AddTimerByKey 指定的回调串行 key, 未指定时为 -; 缺少 slack_ms 和 key 的 add 行按 0 和未指定读取
+
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+
+// 单个操作
+struct TimerTraceOp {
+	enum Kind : uint8_t {
+		ADD,
+		DEL,
+	};
+
+	uint64_t offset_us = 0;    // 相对记录开始的时间
+	Kind kind = ADD;
+	int64_t id = 0;            // 记录时的定时器 id
+	uint64_t timing_ms = 0;    // 定时时间, 只用于 ADD
+	bool is_loop = false;      // 是否循环定时, 只用于 ADD
+	uint64_t slack_ms = 0;     // 允许延后触发的时间, 只用于 ADD
+	uint64_t key = UINT64_MAX; // 回调串行 key, UINT64_MAX 表示未指定; 只用于 ADD
+};
+
+// 轨迹记录器, 可以在多个线程中同时记录
+class TimerTraceRecorder {
+public:
+	TimerTraceRecorder() : _start(std::chrono::steady_clock::now()) {
+	}
+
+	// 记录添加定时器, id 为 AddTimer/AddTimerByKey 的返回值
+	// key       回调串行 key, UINT64_MAX 表示未指定
+	void Add(int64_t id, uint64_t timing_ms, bool is_loop, uint64_t slack_ms = 0, uint64_t key = UINT64_MAX) {
+		if (id < 0) {
+			return;
+		}
+
+		TimerTraceOp op;
+		op.kind = TimerTraceOp::ADD;
+		op.id = id;
+		op.timing_ms = timing_ms;
+		op.is_loop = is_loop;
+		op.slack_ms = slack_ms;
+		op.key = key;
+		_push(op);
+	}
+
+	// 记录删除定时器
+	void Del(int64_t id) {
+		TimerTraceOp op;
+		op.kind = TimerTraceOp::DEL;
+		op.id = id;
+		_push(op);
+	}
+
+	// 按时间顺序写入文件, 失败时返回 false
+	bool Save(const char *path) {
+		std::unique_lock<std::mutex> lock(_mtx);
+		std::stable_sort(_ops.begin(), _ops.end(), [](const TimerTraceOp &lhs, const TimerTraceOp &rhs) {
+			return lhs.offset_us < rhs.offset_us;
+		});
+
+		std::FILE *file = std::fopen(path, "w");
+		if (!file) {
+			return false;
+		}
+
+		for (auto &op : _ops) {
+			if (op.kind == TimerTraceOp::ADD) {
+				std::fprintf(file, "%llu add %lld %llu %d %llu ", (unsigned long long) op.offset_us, (long long) op.id,
+				             (unsigned long long) op.timing_ms, op.is_loop ? 1 : 0, (unsigned long long) op.slack_ms);
+				if (op.key == UINT64_MAX) {
+					std::fputs("-\n", file);
+				} else {
+					std::fprintf(file, "%llu\n", (unsigned long long) op.key);
+				}
+			} else {
+				std::fprintf(file, "%llu del %lld\n", (unsigned long long) op.offset_us, (long long) op.id);
+			}
+		}
+
+		return std::fclose(file) == 0;
+	}
+
+	// 已记录的操作数量
+	size_t Size() {
+		std::unique_lock<std::mutex> lock(_mtx);
+		return _ops.size();
+	}
+
+
+private:
+	void _push(TimerTraceOp &op) {
+		op.offset_us = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - _start).count();
+
+		std::unique_lock<std::mutex> lock(_mtx);
+		_ops.push_back(op);
+	}
+
+	std::chrono::steady_clock::time_point _start; // 记录开始时间
+	std::mutex _mtx;                              // 保护 _ops
+	std::vector<TimerTraceOp> _ops;               // 已记录的操作
+};
+
+// 记录调用轨迹的定时器, 其余接口与 Timer 相同
+// AddTimer/AddTimerByKey/DelTimer 转发给 Timer, 设置了记录器时同时记录调用参数和返回的 id;
+// 可以包装 MinHeapTimerLoop、ShardedMinHeapTimer 等提供 AddTimerByKey 的定时器
+// T     节点数据类型
+// Timer 被包装的定时器
+template<class T, class Timer>
+class TimerTraceRecording : public Timer {
+public:
+	using Callback = typename Timer::Callback;
+	using Timer::Timer;
+
+	// 设置记录器, 为 nullptr 时不记录; recorder 需要在定时器停止使用前保持有效
+	void SetRecorder(TimerTraceRecorder *recorder) {
+		_recorder = recorder;
+	}
+
+	int64_t AddTimer(uint64_t timing_ms, const T &data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		int64_t id = Timer::AddTimer(timing_ms, data, std::move(fb), is_loop, slack_ms);
+		_recordAdd(id, timing_ms, is_loop, slack_ms, UINT64_MAX);
+		return id;
+	}
+
+	int64_t AddTimer(uint64_t timing_ms, T &&data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		int64_t id = Timer::AddTimer(timing_ms, std::move(data), std::move(fb), is_loop, slack_ms);
+		_recordAdd(id, timing_ms, is_loop, slack_ms, UINT64_MAX);
+		return id;
+	}
+
+	int64_t AddTimerByKey(uint64_t key, uint64_t timing_ms, const T &data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		int64_t id = Timer::AddTimerByKey(key, timing_ms, data, std::move(fb), is_loop, slack_ms);
+		_recordAdd(id, timing_ms, is_loop, slack_ms, key);
+		return id;
+	}
+
+	int64_t AddTimerByKey(uint64_t key, uint64_t timing_ms, T &&data, Callback fb, bool is_loop = false, uint64_t slack_ms = 0) {
+		int64_t id = Timer::AddTimerByKey(key, timing_ms, std::move(data), std::move(fb), is_loop, slack_ms);
+		_recordAdd(id, timing_ms, is_loop, slack_ms, key);
+		return id;
+	}
+
+	bool DelTimer(int64_t id) {
+		bool deleted = Timer::DelTimer(id);
+		if (_recorder) {
+			_recorder->Del(id);
+		}
+		return deleted;
+	}
+
+
+private:
+	inline void _recordAdd(int64_t id, uint64_t timing_ms, bool is_loop, uint64_t slack_ms, uint64_t key) {
+		if (_recorder) {
+			_recorder->Add(id, timing_ms, is_loop, slack_ms, key);
+		}
+	}
+
+	TimerTraceRecorder *_recorder = nullptr; // 记录器, 为空时不记录
+};
+
+// 读取轨迹文件, 忽略空行和 # 开头的注释行; 失败时返回 false, error 为出错原因
+inline bool LoadTimerTrace(const char *path, std::vector<TimerTraceOp> &ops, std::string &error) {
+	ops.clear();
+
+	std::FILE *file = std::fopen(path, "r");
+	if (!file) {
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+
+	char line[256];
+	size_t lineno = 0;
+	while (std::fgets(line, sizeof(line), file)) {
+		lineno++;
+		if (line[0] == '\n' || line[0] == '#' || line[0] == '\0') {
+			continue;
+		}
+
+		TimerTraceOp op;
+		unsigned long long offset = 0, timing = 0, slack = 0;
+		long long id = 0;
+		int is_loop = 0;
+		char kind[8] = {0};
+		char key[32] = {0};
+
+		int n = std::sscanf(line, "%llu %7s %lld %llu %d %llu %31s", &offset, kind, &id, &timing, &is_loop, &slack, key);
+		char *end = key;
+		if (n == 7 && std::strcmp(key, "-") != 0) {
+			op.key = std::strtoull(key, &end, 10);
+		}
+
+		if ((n == 5 || (n == 7 && (std::strcmp(key, "-") == 0 || (end != key && *end == '\0')))) && std::strcmp(kind, "add") == 0) {
+			op.kind = TimerTraceOp::ADD;
+			op.timing_ms = timing;
+			op.is_loop = is_loop != 0;
+			op.slack_ms = slack;
+		} else if (n >= 3 && std::strcmp(kind, "del") == 0) {
+			op.kind = TimerTraceOp::DEL;
+		} else {
+			error = std::string(path) + ":" + std::to_string(lineno) + ": malformed line";
+			std::fclose(file);
+			return false;
+		}
+
+		op.offset_us = offset;
+		op.id = id;
+		ops.push_back(op);
+	}
+
+	std::fclose(file);
+	return true;
+}
+
+
+#endif //_TIMER_TRACE_HPP
@@ -0,0 +1,364 @@
+﻿// 点云过期负载模拟与轨迹回放
+// gen:    模拟多个激光雷达以固定频率产生点云帧, 每帧添加一个 TTL 定时器, 大部分帧被消费后删除定时器,
+//         同时运行若干循环的清理定时器; 可以把调用序列记录为轨迹文件
+// replay: 按原始时间间隔把轨迹文件回放到指定的定时器实现
+// 结果输出一行 JSON: 操作数量、触发数量、触发延迟分布和 AddTimer 耗时
+//
+// 用法:
+//   timer_workload gen [--backend heap|wheel|sharded] [--shards N] [--sensors N] [--hz N] [--points N]
+//                      [--ttl ms] [--ttl-jitter ms] [--consume ratio] [--consume-delay ms]
+//                      [--housekeeping N] [--housekeeping-ms ms] [--duration s] [--record path]
+//   timer_workload replay --trace path [--backend heap|wheel|sharded] [--shards N] [--speed x] [--drain-ms ms]
+
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include "MinHeapTimer.hpp"
+#include "TimingWheelTimer.hpp"
+#include "ShardedMinHeapTimer.hpp"
+#include "timer_trace.hpp"
+
+
+// 点云帧, 定时器节点数据
+struct Frame {
+	uint32_t sensor = 0; // 雷达编号
+	uint32_t seq = 0;    // 帧序号
+	uint32_t points = 0; // 点数
+};
+
+// 全部后端都经过 TimerTraceRecording, gen 模式下设置记录器后在 AddTimer/AddTimerByKey/DelTimer 中记录轨迹
+using HeapBackend = TimerTraceRecording<Frame, MinHeapTimerLoop<Frame>>;
+using WheelBackend = TimerTraceRecording<Frame, MinHeapTimerLoop<Frame, TimingWheelTimer<Frame>>>;
+using ShardedBackend = TimerTraceRecording<Frame, ShardedMinHeapTimer<Frame, MinHeapTimerLoop<Frame>>>;
+
+struct Options {
+	std::string mode;
+	std::string backend = "heap";
+	size_t shards = 0;
+
+	// gen
+	uint32_t sensors = 16;
+	uint32_t hz = 10;
+	uint32_t points = 120000;
+	uint64_t ttl_ms = 200;
+	uint64_t ttl_jitter_ms = 50;
+	double consume = 0.9;
+	uint64_t consume_delay_ms = 30;
+	uint32_t housekeeping = 4;
+	uint64_t housekeeping_ms = 100;
+	double duration_s = 5;
+	std::string record;
+
+	// replay
+	std::string trace;
+	double speed = 1.0;
+	uint64_t drain_ms = 1000;
+};
+
+// 运行结果
+struct Metrics {
+	std::atomic<uint64_t> adds{0};
+	std::atomic<uint64_t> cancels{0};
+	std::atomic<uint64_t> cancel_misses{0}; // 删除时定时器已过期
+	std::atomic<uint64_t> fires{0};
+	std::atomic<uint64_t> loop_fires{0};
+	TimerHistogram lateness_ms;             // 触发延迟
+	TimerHistogram add_ns;                  // AddTimer 耗时
+};
+
+static void Usage() {
+	std::fprintf(stderr,
+	             "usage: timer_workload gen [--backend heap|wheel|sharded] [--shards N] [--sensors N] [--hz N] [--points N]\n"
+	             "                          [--ttl ms] [--ttl-jitter ms] [--consume ratio] [--consume-delay ms]\n"
+	             "                          [--housekeeping N] [--housekeeping-ms ms] [--duration s] [--record path]\n"
+	             "       timer_workload replay --trace path [--backend heap|wheel|sharded] [--shards N] [--speed x] [--drain-ms ms]\n");
+}
+
+static bool ParseOptions(int argc, char **argv, Options &opts) {
+	if (argc < 2) {
+		return false;
+	}
+
+	opts.mode = argv[1];
+	if (opts.mode != "gen" && opts.mode != "replay") {
+		return false;
+	}
+
+	for (int i = 2; i + 1 < argc; i += 2) {
+		const char *key = argv[i];
+		const char *value = argv[i + 1];
+		if (std::strcmp(key, "--backend") == 0) {
+			opts.backend = value;
+		} else if (std::strcmp(key, "--shards") == 0) {
+			opts.shards = (size_t) std::strtoull(value, nullptr, 10);
+		} else if (std::strcmp(key, "--sensors") == 0) {
+			opts.sensors = (uint32_t) std::strtoul(value, nullptr, 10);
+		} else if (std::strcmp(key, "--hz") == 0) {
+			opts.hz = (uint32_t) std::strtoul(value, nullptr, 10);
+		} else if (std::strcmp(key, "--points") == 0) {
+			opts.points = (uint32_t) std::strtoul(value, nullptr, 10);
+		} else if (std::strcmp(key, "--ttl") == 0) {
+			opts.ttl_ms = std::strtoull(value, nullptr, 10);
+		} else if (std::strcmp(key, "--ttl-jitter") == 0) {
+			opts.ttl_jitter_ms = std::strtoull(value, nullptr, 10);
+		} else if (std::strcmp(key, "--consume") == 0) {
+			opts.consume = std::strtod(value, nullptr);
+		} else if (std::strcmp(key, "--consume-delay") == 0) {
+			opts.consume_delay_ms = std::strtoull(value, nullptr, 10);
+		} else if (std::strcmp(key, "--housekeeping") == 0) {
+			opts.housekeeping = (uint32_t) std::strtoul(value, nullptr, 10);
+		} else if (std::strcmp(key, "--housekeeping-ms") == 0) {
+			opts.housekeeping_ms = std::strtoull(value, nullptr, 10);
+		} else if (std::strcmp(key, "--duration") == 0) {
+			opts.duration_s = std::strtod(value, nullptr);
+		} else if (std::strcmp(key, "--record") == 0) {
+			opts.record = value;
+		} else if (std::strcmp(key, "--trace") == 0) {
+			opts.trace = value;
+		} else if (std::strcmp(key, "--speed") == 0) {
+			opts.speed = std::strtod(value, nullptr);
+		} else if (std::strcmp(key, "--drain-ms") == 0) {
+			opts.drain_ms = std::strtoull(value, nullptr, 10);
+		} else {
+			std::fprintf(stderr, "unknown option %s\n", key);
+			return false;
+		}
+	}
+
+	if (opts.mode == "replay" && opts.trace.empty()) {
+		return false;
+	}
+	if (opts.hz == 0 || opts.sensors == 0) {
+		return false;
+	}
+
+	return true;
+}
+
+// 定时回调, 记录触发延迟
+template<class Timer>
+static typename Timer::Callback MakeCallback(Metrics *metrics) {
+	return [metrics](TimerNode<Frame> *node) {
+		uint64_t now = TimeUtils::CurrentTime_ms();
+		metrics->lateness_ms.Record(now > node->expire_ms ? now - node->expire_ms : 0);
+		if (node->is_loop) {
+			metrics->loop_fires.fetch_add(1, std::memory_order_relaxed);
+		} else {
+			metrics->fires.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+}
+
+// 添加定时器并记录耗时
+// key       回调串行 key, UINT64_MAX 时调用 AddTimer, 否则调用 AddTimerByKey
+template<class Timer>
+static TimerId TimedAdd(Timer &timer, Metrics &metrics, uint64_t timing_ms, const Frame &frame, bool is_loop,
+                        uint64_t slack_ms = 0, uint64_t key = UINT64_MAX) {
+	auto start = std::chrono::steady_clock::now();
+	TimerId id = key == UINT64_MAX ? timer.AddTimer(timing_ms, frame, MakeCallback<Timer>(&metrics), is_loop, slack_ms)
+	                               : timer.AddTimerByKey(key, timing_ms, frame, MakeCallback<Timer>(&metrics), is_loop, slack_ms);
+	auto end = std::chrono::steady_clock::now();
+
+	metrics.add_ns.Record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	if (id >= 0) {
+		metrics.adds.fetch_add(1, std::memory_order_relaxed);
+	}
+	return id;
+}
+
+template<class Timer>
+static void TimedDel(Timer &timer, Metrics &metrics, TimerId id) {
+	if (timer.DelTimer(id)) {
+		metrics.cancels.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		metrics.cancel_misses.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// 单个雷达的生产线程: 按频率产生帧, 以雷达编号为串行 key 添加定时器, 消费后删除对应定时器
+template<class Timer>
+static void SensorLoop(Timer &timer, Metrics &metrics, const Options &opts, uint32_t sensor,
+                       std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	struct Pending {
+		TimerId id;
+		std::chrono::steady_clock::time_point consume_at;
+	};
+
+	std::mt19937_64 rng(sensor + 1);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::deque<Pending> pending;
+
+	auto period = std::chrono::microseconds(1000000 / opts.hz);
+	auto next = start + period * sensor / opts.sensors;  // 各雷达错开相位
+	uint32_t seq = 0;
+
+	while (next < end) {
+		std::this_thread::sleep_until(next);
+		auto now = std::chrono::steady_clock::now();
+		next += period;
+
+		// 消费到期的帧, 每帧到来时检查一次, 实际删除时间按帧周期取整
+		while (!pending.empty() && pending.front().consume_at <= now) {
+			TimedDel(timer, metrics, pending.front().id);
+			pending.pop_front();
+		}
+
+		Frame frame;
+		frame.sensor = sensor;
+		frame.seq = seq++;
+		frame.points = opts.points;
+
+		uint64_t ttl = opts.ttl_ms + (opts.ttl_jitter_ms ? rng() % (opts.ttl_jitter_ms + 1) : 0);
+		TimerId id = TimedAdd(timer, metrics, ttl, frame, false, 0, sensor);
+
+		if (id >= 0 && uniform(rng) < opts.consume) {
+			pending.push_back({id, now + std::chrono::milliseconds(opts.consume_delay_ms)});
+		}
+	}
+}
+
+static void Report(const Options &opts, const char *source, Metrics &metrics, double seconds) {
+	std::printf("{\"mode\":\"%s\",\"backend\":\"%s\",\"source\":\"%s\",\"seconds\":%.3f,"
+	            "\"adds\":%llu,\"cancels\":%llu,\"cancel_misses\":%llu,\"fires\":%llu,\"loop_fires\":%llu,"
+	            "\"lateness_ms_p50\":%llu,\"lateness_ms_p99\":%llu,\"lateness_ms_max\":%llu,"
+	            "\"add_ns_mean\":%.1f,\"add_ns_p99\":%llu,\"add_ns_max\":%llu}\n",
+	            opts.mode.c_str(), opts.backend.c_str(), source, seconds,
+	            (unsigned long long) metrics.adds.load(), (unsigned long long) metrics.cancels.load(),
+	            (unsigned long long) metrics.cancel_misses.load(), (unsigned long long) metrics.fires.load(),
+	            (unsigned long long) metrics.loop_fires.load(),
+	            (unsigned long long) metrics.lateness_ms.Percentile(50), (unsigned long long) metrics.lateness_ms.Percentile(99),
+	            (unsigned long long) metrics.lateness_ms.Max(),
+	            metrics.add_ns.Mean(), (unsigned long long) metrics.add_ns.Percentile(99), (unsigned long long) metrics.add_ns.Max());
+	std::fflush(stdout);
+}
+
+// 模拟负载
+template<class Timer>
+static int Generate(Timer &timer, const Options &opts) {
+	Metrics metrics;
+	std::unique_ptr<TimerTraceRecorder> recorder;
+	if (!opts.record.empty()) {
+		recorder.reset(new TimerTraceRecorder());
+		timer.SetRecorder(recorder.get());
+	}
+
+	timer.StartTimerLoop();
+
+	// 循环的清理定时器
+	std::vector<TimerId> housekeeping;
+	for (uint32_t i = 0; i < opts.housekeeping; i++) {
+		housekeeping.push_back(TimedAdd(timer, metrics, opts.housekeeping_ms, Frame(), true));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + std::chrono::microseconds((uint64_t) (opts.duration_s * 1e6));
+
+	std::vector<std::thread> sensors;
+	for (uint32_t i = 0; i < opts.sensors; i++) {
+		sensors.emplace_back([&, i]() {
+			SensorLoop(timer, metrics, opts, i, start, end);
+		});
+	}
+	for (auto &thd : sensors) {
+		thd.join();
+	}
+
+	for (auto id : housekeeping) {
+		TimedDel(timer, metrics, id);
+	}
+
+	// 等待剩余帧过期
+	std::this_thread::sleep_for(std::chrono::milliseconds(opts.ttl_ms + opts.ttl_jitter_ms + 20));
+	timer.StopTimerLoop();
+	timer.SetRecorder(nullptr);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	Report(opts, "synthetic", metrics, seconds);
+
+	if (recorder && !recorder->Save(opts.record.c_str())) {
+		std::fprintf(stderr, "failed to write %s\n", opts.record.c_str());
+		return 1;
+	}
+
+	return 0;
+}
+
+// 回放轨迹
+template<class Timer>
+static int Replay(Timer &timer, const Options &opts) {
+	std::vector<TimerTraceOp> ops;
+	std::string error;
+	if (!LoadTimerTrace(opts.trace.c_str(), ops, error)) {
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	Metrics metrics;
+	std::unordered_map<int64_t, TimerId> ids;  // 轨迹中的 id -> 回放时的 id
+	ids.reserve(ops.size());
+
+	timer.StartTimerLoop();
+	auto start = std::chrono::steady_clock::now();
+
+	for (auto &op : ops) {
+		if (opts.speed > 0) {
+			std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t) ((double) op.offset_us / opts.speed)));
+		}
+
+		if (op.kind == TimerTraceOp::ADD) {
+			ids[op.id] = TimedAdd(timer, metrics, op.timing_ms, Frame(), op.is_loop, op.slack_ms, op.key);
+			continue;
+		}
+
+		auto it = ids.find(op.id);
+		if (it == ids.end()) {
+			continue;  // 轨迹中没有对应的添加
+		}
+		TimedDel(timer, metrics, it->second);
+		ids.erase(it);
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(opts.drain_ms));
+	timer.StopTimerLoop();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	Report(opts, opts.trace.c_str(), metrics, seconds);
+	return 0;
+}
+
+template<class Timer>
+static int Run(Timer &timer, const Options &opts) {
+	return opts.mode == "gen" ? Generate(timer, opts) : Replay(timer, opts);
+}
+
+int main(int argc, char **argv) {
+	Options opts;
+	if (!ParseOptions(argc, argv, opts)) {
+		Usage();
+		return 1;
+	}
+
+	if (opts.backend == "heap") {
+		HeapBackend timer;
+		return Run(timer, opts);
+	} else if (opts.backend == "wheel") {
+		WheelBackend timer;
+		return Run(timer, opts);
+	} else if (opts.backend == "sharded") {
+		ShardedBackend timer(opts.shards);
+		return Run(timer, opts);
+	}
+
+	std::fprintf(stderr, "unknown backend %s\n", opts.backend.c_str());
+	Usage();
+	return 1;
+}
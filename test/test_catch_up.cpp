@@ -0,0 +1,123 @@
+﻿// 循环定时器错过周期时的补偿策略
+
+#include "MinHeapTimer.hpp"
+#include "TimingWheelTimer.hpp"
+#include "timer_test.hpp"
+
+
+// 单次触发的过期时间和合并掉的周期数
+struct Fire {
+	uint64_t expire_ms;
+	uint32_t missed;
+};
+
+// 10ms 循环定时器, 过期处理阻塞 65ms 后处理到补发结束
+// use_default 为 true 时通过 SetDefaultCatchUp 设置策略, 否则添加后通过 SetCatchUp 设置
+template<class Timer>
+static std::vector<Fire> Stall(TimerExpireMode mode, TimerCatchUp policy, uint32_t burst_cap, bool use_default) {
+	Timer timer;
+	timer.SetExpireMode(mode);
+	if (use_default) {
+		timer.SetDefaultCatchUp(policy, burst_cap);
+	}
+
+	std::vector<Fire> fires;
+	TimerId id = timer.AddTimer(10, 0, [&](TimerNode<int> *node) {
+		fires.push_back({node->expire_ms, node->missed});
+	}, true);
+	if (!use_default) {
+		TIMER_CHECK(timer.SetCatchUp(id, policy, burst_cap));
+	}
+
+	SleepMs(65);
+	uint64_t stalled = TimeUtils::CurrentTime_ms();
+
+	// Unlocked 模式每次处理只回调一次, Burst 需要多次处理才能补发完; 只保留阻塞期间到期的周期
+	size_t count;
+	do {
+		count = fires.size();
+		timer.ExpireTimer();
+	} while (fires.size() != count && fires.back().expire_ms <= stalled);
+
+	while (fires.size() > 1 && fires.back().expire_ms > stalled) {
+		fires.pop_back();
+	}
+
+	// 补发结束后下一次过期时间在当前时间之后
+	std::vector<TimerNode<int> *> nodes;
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 1);
+	TIMER_CHECK(nodes[0]->expire_ms > fires.back().expire_ms);
+	TIMER_CHECK(nodes[0]->expire_ms + 10 > TimeUtils::CurrentTime_ms());
+	return fires;
+}
+
+// 触发代表的周期总数
+static uint64_t Periods(const std::vector<Fire> &fires) {
+	uint64_t total = 0;
+	for (auto &fire : fires) {
+		total += fire.missed + 1;
+	}
+	return total;
+}
+
+template<class Timer>
+static void TestPolicies(TimerExpireMode mode) {
+	for (bool use_default : {false, true}) {
+		// 只触发一次, 错过的周期记录在 missed 中
+		auto fires = Stall<Timer>(mode, TimerCatchUp::FireOnce, 0, use_default);
+		TIMER_CHECK(fires.size() == 1);
+		TIMER_CHECK(fires[0].missed >= 5);
+
+		// 跳过, 不记录
+		fires = Stall<Timer>(mode, TimerCatchUp::Skip, 0, use_default);
+		TIMER_CHECK(fires.size() == 1);
+		TIMER_CHECK(fires[0].missed == 0);
+
+		// 不限次数逐个补发
+		fires = Stall<Timer>(mode, TimerCatchUp::Burst, 0, use_default);
+		TIMER_CHECK(fires.size() >= 6);
+		for (size_t i = 1; i < fires.size(); i++) {
+			TIMER_CHECK(fires[i].expire_ms == fires[i - 1].expire_ms + 10);
+		}
+
+		// 连续补发不超过 burst_cap, 超出的周期计入 missed
+		fires = Stall<Timer>(mode, TimerCatchUp::Burst, 2, use_default);
+		TIMER_CHECK(fires.size() <= 3);
+		TIMER_CHECK(Periods(fires) >= 6);
+	}
+}
+
+// 未设置时默认为 FireOnce
+template<class Timer>
+static void TestDefaultPolicy() {
+	Timer timer;
+	std::vector<Fire> fires;
+	timer.AddTimer(10, 0, [&](TimerNode<int> *node) {
+		TIMER_CHECK(node->catch_up == TimerCatchUp::FireOnce);
+		fires.push_back({node->expire_ms, node->missed});
+	}, true);
+
+	SleepMs(65);
+	timer.ExpireTimer();
+	TIMER_CHECK(fires.size() == 1);
+	TIMER_CHECK(fires[0].missed >= 5);
+}
+
+static void TestHeap() {
+	TestDefaultPolicy<MinHeapTimer<int>>();
+	TestPolicies<MinHeapTimer<int>>(TimerExpireMode::Locked);
+	TestPolicies<MinHeapTimer<int>>(TimerExpireMode::Unlocked);
+}
+
+static void TestWheel() {
+	TestDefaultPolicy<TimingWheelTimer<int>>();
+	TestPolicies<TimingWheelTimer<int>>(TimerExpireMode::Locked);
+	TestPolicies<TimingWheelTimer<int>>(TimerExpireMode::Unlocked);
+}
+
+
+int main() {
+	TIMER_RUN(TestHeap);
+	TIMER_RUN(TestWheel);
+	return 0;
+}
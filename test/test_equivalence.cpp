@@ -0,0 +1,164 @@
+﻿// 时间轮与最小堆的等价性: 相同的随机操作序列触发相同的定时器
+
+#include <random>
+#include <algorithm>
+#include "MinHeapTimer.hpp"
+#include "TimingWheelTimer.hpp"
+#include "timer_test.hpp"
+
+
+// 按相同的操作序列驱动一个定时器, 记录触发的节点数据
+template<class Timer>
+class Driver {
+public:
+	explicit Driver(TimerExpireMode mode) {
+		_timer.SetExpireMode(mode);
+	}
+
+	void Add(int data, uint64_t timing_ms, bool is_loop, uint64_t slack_ms) {
+		_ids.push_back(_timer.AddTimer(timing_ms, data, [this](TimerNode<int> *node) {
+			TIMER_CHECK(TimeUtils::CurrentTime_ms() >= node->expire_ms);
+			_fired.insert(_fired.end(), node->missed + 1, node->data);  // 按代表的周期数记录
+		}, is_loop, slack_ms));
+		TIMER_CHECK(_ids.back() >= 0);
+	}
+
+	bool Del(size_t index) {
+		return _timer.DelTimer(_ids[index]);
+	}
+
+	bool Reset(size_t index, uint64_t timing_ms) {
+		return _timer.ResetTimer(_ids[index], timing_ms);
+	}
+
+	void Expire() {
+		_timer.ExpireTimer();
+	}
+
+	size_t Pending() {
+		std::vector<TimerNode<int> *> nodes;
+		return _timer.GetTimerNode(nodes);
+	}
+
+	// 排序后的触发记录, 循环定时器合并触发时记录多次; 同一毫秒内的触发顺序不要求一致
+	std::vector<int> Fired() const {
+		auto fired = _fired;
+		std::sort(fired.begin(), fired.end());
+		return fired;
+	}
+
+
+private:
+	Timer _timer;
+	std::vector<TimerId> _ids;
+	std::vector<int> _fired;
+};
+
+// 随机添加、删除、重设一次性定时器, 处理到全部过期后比较触发记录
+// 删除和重设只作用于远未过期的定时器, 两个定时器的结果不受操作间隔影响
+static void RunWorkload(TimerExpireMode mode, uint32_t seed) {
+	Driver<MinHeapTimer<int>> heap(mode);
+	Driver<TimingWheelTimer<int>> wheel(mode);
+
+	std::mt19937 rng(seed);
+	std::vector<size_t> far;  // 远未过期的定时器下标
+	size_t count = 0;
+	size_t deleted = 0;
+
+	for (int i = 0; i < 2000; i++) {
+		uint32_t op = rng() % 10;
+		if (op < 6 || far.empty()) {
+			bool is_far = rng() % 4 == 0;
+			uint64_t timing = is_far ? 100000 + rng() % 1000 : rng() % 300;  // 覆盖时间轮的 0、1 两层
+			uint64_t slack = rng() % 3 == 0 ? rng() % 20 : 0;
+			heap.Add((int) count, timing, false, slack);
+			wheel.Add((int) count, timing, false, slack);
+			if (is_far) {
+				far.push_back(count);
+			}
+			count++;
+		} else if (op < 8) {
+			size_t pick = rng() % far.size();
+			TIMER_CHECK(heap.Del(far[pick]));
+			TIMER_CHECK(wheel.Del(far[pick]));
+			far.erase(far.begin() + (ptrdiff_t) pick);
+			deleted++;
+		} else {
+			size_t pick = rng() % far.size();
+			uint64_t timing = rng() % 300;
+			TIMER_CHECK(heap.Reset(far[pick], timing));
+			TIMER_CHECK(wheel.Reset(far[pick], timing));
+			far.erase(far.begin() + (ptrdiff_t) pick);
+		}
+
+		if (i % 100 == 0) {
+			heap.Expire();
+			wheel.Expire();
+		}
+	}
+
+	// 未删除的远期定时器不会触发
+	uint64_t end = TimeUtils::CurrentTime_ms() + 400;
+	while (TimeUtils::CurrentTime_ms() < end) {
+		heap.Expire();
+		wheel.Expire();
+		SleepMs(1);
+	}
+
+	TIMER_CHECK(heap.Pending() == far.size());
+	TIMER_CHECK(wheel.Pending() == far.size());
+
+	auto fired = heap.Fired();
+	TIMER_CHECK(fired == wheel.Fired());
+	TIMER_CHECK(std::adjacent_find(fired.begin(), fired.end()) == fired.end());
+	TIMER_CHECK(fired.size() == count - far.size() - deleted);
+}
+
+// 循环定时器在相同时间段内经过的周期数一致 (允许处理时刻不同带来的一次偏差)
+static void RunLoops(TimerExpireMode mode) {
+	Driver<MinHeapTimer<int>> heap(mode);
+	Driver<TimingWheelTimer<int>> wheel(mode);
+
+	for (int i = 0; i < 8; i++) {
+		uint64_t period = 5 + (uint64_t) i * 7;
+		heap.Add(i, period, true, 0);
+		wheel.Add(i, period, true, 0);
+	}
+
+	uint64_t end = TimeUtils::CurrentTime_ms() + 200;
+	while (TimeUtils::CurrentTime_ms() < end) {
+		heap.Expire();
+		wheel.Expire();
+		SleepMs(1);
+	}
+
+	auto heap_fired = heap.Fired();
+	auto wheel_fired = wheel.Fired();
+	for (int i = 0; i < 8; i++) {
+		auto lhs = std::count(heap_fired.begin(), heap_fired.end(), i);
+		auto rhs = std::count(wheel_fired.begin(), wheel_fired.end(), i);
+		TIMER_CHECK(lhs > 0);
+		TIMER_CHECK(lhs <= rhs + 1 && rhs <= lhs + 1);
+	}
+}
+
+static void TestLocked() {
+	for (uint32_t seed = 1; seed <= 3; seed++) {
+		RunWorkload(TimerExpireMode::Locked, seed);
+	}
+	RunLoops(TimerExpireMode::Locked);
+}
+
+static void TestUnlocked() {
+	for (uint32_t seed = 1; seed <= 3; seed++) {
+		RunWorkload(TimerExpireMode::Unlocked, seed);
+	}
+	RunLoops(TimerExpireMode::Unlocked);
+}
+
+
+int main() {
+	TIMER_RUN(TestLocked);
+	TIMER_RUN(TestUnlocked);
+	return 0;
+}
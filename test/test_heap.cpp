@@ -0,0 +1,164 @@
+﻿// 最小堆定时器: 延迟删除的墓碑压缩、延迟调整
+
+#include "MinHeapTimer.hpp"
+#include "timer_test.hpp"
+
+
+// 暴露最小堆内部状态用于检查
+class HeapProbe : public MinHeapTimer<int> {
+public:
+	size_t HeapSize() const {
+		return _heap.size();
+	}
+
+	size_t Tombstones() const {
+		return _tombstones;
+	}
+
+	// 堆顶的排序过期时间
+	uint64_t FrontKey() const {
+		return _heap.front().expire_ms;
+	}
+};
+
+
+// 墓碑超过压缩阈值时整体压缩, 删除后的 id 立即失效
+static void TestTombstoneCompaction() {
+	HeapProbe timer;
+	timer.SetLazyDelete(true);
+	timer.SetCompactRatio(0.25);
+
+	std::vector<TimerId> ids;
+	for (int i = 0; i < 100; i++) {
+		ids.push_back(timer.AddTimer(100000, i, [](TimerNode<int> *) {}));
+	}
+
+	for (int i = 0; i < 25; i++) {
+		TIMER_CHECK(timer.DelTimer(ids[i]));
+		TIMER_CHECK(!timer.DelTimer(ids[i]));
+	}
+	TIMER_CHECK(timer.HeapSize() == 100);
+	TIMER_CHECK(timer.Tombstones() == 25);
+
+	std::vector<TimerNode<int> *> nodes;
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 75);
+
+	// 第 26 个墓碑超过 100 * 0.25, 触发压缩
+	TIMER_CHECK(timer.DelTimer(ids[25]));
+	TIMER_CHECK(timer.HeapSize() == 74);
+	TIMER_CHECK(timer.Tombstones() == 0);
+
+	// 关闭延迟删除时压缩剩余墓碑
+	TIMER_CHECK(timer.DelTimer(ids[26]));
+	TIMER_CHECK(timer.Tombstones() == 1);
+	timer.SetLazyDelete(false);
+	TIMER_CHECK(timer.HeapSize() == 73);
+	TIMER_CHECK(timer.Tombstones() == 0);
+
+	// 批量删除全部节点后堆为空, 之后仍可正常添加和触发
+	TIMER_CHECK(timer.DelTimers(ids.data() + 27, 73) == 73);
+	TIMER_CHECK(timer.HeapSize() == 0);
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 0);
+
+	int fired = 0;
+	timer.AddTimer(1, 0, [&](TimerNode<int> *) { fired++; });
+	SleepMs(5);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired == 1);
+	TIMER_CHECK(timer.HeapSize() == 0);
+}
+
+// 到达堆顶的墓碑被丢弃, 不回调
+static void TestTombstoneAtFront() {
+	HeapProbe timer;
+	timer.SetLazyDelete(true);
+	timer.SetCompactRatio(1.0);
+
+	int fired = 0;
+	TimerId near = timer.AddTimer(1, 0, [&](TimerNode<int> *) { fired += 100; });
+	timer.AddTimer(2, 1, [&](TimerNode<int> *) { fired++; });
+	timer.AddTimer(100000, 2, [](TimerNode<int> *) {});
+
+	TIMER_CHECK(timer.DelTimer(near));
+	TIMER_CHECK(timer.Tombstones() == 1);
+
+	SleepMs(10);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired == 1);
+	TIMER_CHECK(timer.Tombstones() == 0);
+	TIMER_CHECK(timer.HeapSize() == 1);
+}
+
+// 延迟调整: 推迟过期时间时堆中保留旧的排序时间, 节点到达堆顶时下沉, 按新的过期时间触发
+static void TestLazyReset() {
+	HeapProbe timer;
+	timer.SetLazyReset(true);
+
+	uint64_t fired_at = 0;
+	TimerId id = timer.AddTimer(10, 0, [&](TimerNode<int> *) { fired_at = TimeUtils::CurrentTime_ms(); });
+	uint64_t key = timer.FrontKey();
+
+	uint64_t reset_at = TimeUtils::CurrentTime_ms();
+	TIMER_CHECK(timer.ResetTimer(id, 60));
+	TIMER_CHECK(timer.FrontKey() == key);
+
+	SleepMs(20);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired_at == 0);
+	TIMER_CHECK(timer.FrontKey() >= reset_at + 60);
+
+	SleepMs(60);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired_at >= reset_at + 60);
+	TIMER_CHECK(timer.HeapSize() == 0);
+
+	// 提前过期时间立即上浮
+	fired_at = 0;
+	timer.AddTimer(100000, 1, [](TimerNode<int> *) {});
+	id = timer.AddTimer(100000, 2, [&](TimerNode<int> *) { fired_at = TimeUtils::CurrentTime_ms(); });
+	reset_at = TimeUtils::CurrentTime_ms();
+	TIMER_CHECK(timer.ResetTimer(id, 5));
+	TIMER_CHECK(timer.FrontKey() <= TimeUtils::CurrentTime_ms() + 5);
+
+	SleepMs(15);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired_at >= reset_at + 5);
+	TIMER_CHECK(timer.HeapSize() == 1);
+}
+
+// 容差合并: 最早的最晚触发时间到达时, 已到过期时间的其它定时器同批触发, 不早于各自的过期时间
+static void TestSlackCoalescing() {
+	MinHeapTimer<int> timer;
+
+	std::vector<int> fired;
+	uint64_t start = TimeUtils::CurrentTime_ms();
+	auto fb = [&](TimerNode<int> *node) {
+		TIMER_CHECK(TimeUtils::CurrentTime_ms() >= node->expire_ms);
+		fired.push_back(node->data);
+	};
+	timer.AddTimer(10, 0, fb, false, 100);   // 最晚 110ms
+	timer.AddTimer(30, 1, fb, false, 0);     // 30ms, 带动 0 一起触发
+	timer.AddTimer(200, 2, fb, false, 10);   // 尚未过期, 不提前触发
+
+	while (fired.size() < 2 && TimeUtils::CurrentTime_ms() < start + 150) {
+		timer.ExpireTimer();
+		SleepMs(1);
+	}
+	TIMER_CHECK(fired.size() == 2);
+	TIMER_CHECK(TimeUtils::CurrentTime_ms() < start + 110);
+
+	// 最晚触发时间不溢出
+	timer.AddTimer(1, 3, fb, false, UINT64_MAX);
+	SleepMs(5);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired.size() == 2);
+}
+
+
+int main() {
+	TIMER_RUN(TestTombstoneCompaction);
+	TIMER_RUN(TestTombstoneAtFront);
+	TIMER_RUN(TestLazyReset);
+	TIMER_RUN(TestSlackCoalescing);
+	return 0;
+}
@@ -0,0 +1,174 @@
+﻿// 回调中重入删除, 以及 Unlocked 模式下同一批次中被删除的节点不再回调
+
+#include <algorithm>
+#include "MinHeapTimer.hpp"
+#include "TimingWheelTimer.hpp"
+#include "timer_test.hpp"
+
+
+// 同一批次过期的 a、b、c, a 的回调中删除 b 和自身, 添加新的定时器
+template<class Timer>
+static void TestDeleteInCallback(TimerExpireMode mode) {
+	Timer timer;
+	timer.SetExpireMode(mode);
+
+	std::vector<int> fired;
+	TimerId a = -1, b = -1;
+	auto fb = [&](TimerNode<int> *node) {
+		fired.push_back(node->data);
+	};
+
+	// a 的过期时间早于 b、c, 保证先回调
+	a = timer.AddTimer(0, 0, [&](TimerNode<int> *node) {
+		fired.push_back(node->data);
+		TIMER_CHECK(timer.DelTimer(b));
+		TIMER_CHECK(!timer.DelTimer(b));
+		TIMER_CHECK(timer.DelTimer(a));
+		TIMER_CHECK(timer.AddTimer(1, 3, fb) >= 0);
+	}, true);
+	b = timer.AddTimer(2, 1, fb);
+	timer.AddTimer(2, 2, fb);
+
+	SleepMs(5);
+	timer.ExpireTimer();
+	TIMER_CHECK(std::count(fired.begin(), fired.end(), 0) == 1);
+	TIMER_CHECK(std::count(fired.begin(), fired.end(), 1) == 0);
+	TIMER_CHECK(std::count(fired.begin(), fired.end(), 2) == 1);
+
+	// a 是循环定时器, 删除自身后不再重新添加; 只剩回调中添加的定时器
+	std::vector<TimerNode<int> *> nodes;
+	TIMER_CHECK(!timer.DelTimer(a));
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 1);
+
+	SleepMs(5);
+	timer.ExpireTimer();
+	TIMER_CHECK(std::count(fired.begin(), fired.end(), 0) == 1);
+	TIMER_CHECK(std::count(fired.begin(), fired.end(), 3) == 1);
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 0);
+}
+
+// 批量删除同一批次中的其它节点
+template<class Timer>
+static void TestDelTimersInCallback(TimerExpireMode mode) {
+	Timer timer;
+	timer.SetExpireMode(mode);
+
+	int fired = 0;
+	std::vector<TimerId> ids(8);
+	ids[0] = timer.AddTimer(0, 0, [&](TimerNode<int> *) {
+		fired++;
+		TIMER_CHECK(timer.DelTimers(ids.data() + 1, ids.size() - 1) == ids.size() - 1);
+	});
+	for (size_t i = 1; i < ids.size(); i++) {
+		ids[i] = timer.AddTimer(2, (int) i, [&](TimerNode<int> *) { fired += 100; });
+	}
+
+	SleepMs(10);
+	timer.ExpireTimer();
+	TIMER_CHECK(fired == 1);
+
+	std::vector<TimerNode<int> *> nodes;
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 0);
+}
+
+// Unlocked 模式: 回调执行时不持锁, 其它线程删除同一批次中尚未回调的节点后不再回调
+template<class Timer>
+static void TestUnlockedSkip() {
+	Timer timer;
+	timer.SetExpireMode(TimerExpireMode::Unlocked);
+
+	std::atomic<int> fired{0};
+	std::atomic<bool> entered{false}, deleted{false};
+	TimerId b = -1;
+
+	timer.AddTimer(0, 0, [&](TimerNode<int> *) {
+		entered = true;
+		while (!deleted.load()) {
+			std::this_thread::yield();
+		}
+		fired++;
+	});
+	b = timer.AddTimer(2, 1, [&](TimerNode<int> *) { fired += 100; });
+
+	SleepMs(5);
+	std::thread expire([&] { timer.ExpireTimer(); });
+	while (!entered.load()) {
+		std::this_thread::yield();
+	}
+
+	// 回调期间不持锁, 可以添加和删除
+	TIMER_CHECK(timer.DelTimer(b));
+	TIMER_CHECK(!timer.DelTimer(b));
+	TIMER_CHECK(timer.AddTimer(100000, 2, [](TimerNode<int> *) {}) >= 0);
+	deleted = true;
+	expire.join();
+
+	TIMER_CHECK(fired.load() == 1);
+	std::vector<TimerNode<int> *> nodes;
+	TIMER_CHECK(timer.GetTimerNode(nodes) == 1);
+}
+
+template<class Timer>
+static void TestAll() {
+	TestDeleteInCallback<Timer>(TimerExpireMode::Locked);
+	TestDeleteInCallback<Timer>(TimerExpireMode::Unlocked);
+	TestDelTimersInCallback<Timer>(TimerExpireMode::Locked);
+	TestDelTimersInCallback<Timer>(TimerExpireMode::Unlocked);
+	TestUnlockedSkip<Timer>();
+}
+
+static void TestHeap() {
+	TestAll<MinHeapTimer<int>>();
+}
+
+static void TestWheel() {
+	TestAll<TimingWheelTimer<int>>();
+}
+
+// 定时线程中重入调用 DelTimer/AddTimer 不会在命令队列满时空转
+template<class Timer>
+static void TestLoopQueue(TimerExpireMode mode) {
+	MinHeapTimerLoop<int, Timer> loop;
+	loop.SetExpireMode(mode);
+	loop.EnableCommandQueue(2);
+
+	std::vector<TimerId> far;
+	for (int i = 0; i < 10; i++) {
+		far.push_back(loop.AddTimer(100000, i, [](TimerNode<int> *) {}));
+	}
+
+	std::atomic<int> fired{0};
+	loop.StartTimerLoop();
+	loop.AddTimer(5, 0, [&](TimerNode<int> *) {
+		for (int i = 0; i < 4; i++) {
+			loop.DelTimer(far[i]);
+		}
+		loop.AddTimer(1, 0, [&](TimerNode<int> *) { fired++; });
+		fired++;
+	});
+
+	SleepMs(100);
+	TIMER_CHECK(fired.load() == 2);
+	std::vector<TimerNode<int> *> nodes;
+	TIMER_CHECK(loop.GetTimerNode(nodes) == 6);
+
+	TIMER_CHECK(loop.DelTimers(far.data() + 4, 6) == 6);
+	SleepMs(30);
+	TIMER_CHECK(loop.GetTimerNode(nodes) == 0);
+	loop.StopTimerLoop();
+}
+
+static void TestLoop() {
+	TestLoopQueue<MinHeapTimer<int>>(TimerExpireMode::Locked);
+	TestLoopQueue<MinHeapTimer<int>>(TimerExpireMode::Unlocked);
+	TestLoopQueue<TimingWheelTimer<int>>(TimerExpireMode::Locked);
+	TestLoopQueue<TimingWheelTimer<int>>(TimerExpireMode::Unlocked);
+}
+
+
+int main() {
+	TIMER_RUN(TestHeap);
+	TIMER_RUN(TestWheel);
+	TIMER_RUN(TestLoop);
+	return 0;
+}
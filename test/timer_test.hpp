@@ -0,0 +1,35 @@
+﻿#ifndef _TIMER_TEST_HPP
+#define _TIMER_TEST_HPP
+
+// 测试公用的检查宏和工具函数
+// 检查失败时输出位置并退出, 不依赖 assert, Release 构建同样生效
+
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+
+#define TIMER_CHECK(cond)                                                                      \
+	do {                                                                                       \
+		if (!(cond)) {                                                                         \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);      \
+			std::exit(1);                                                                      \
+		}                                                                                      \
+	} while (0)
+
+// 运行一个测试用例并输出名称
+#define TIMER_RUN(test)                      \
+	do {                                     \
+		std::printf("[ RUN  ] %s\n", #test); \
+		test();                              \
+		std::printf("[  OK  ] %s\n", #test); \
+	} while (0)
+
+
+inline void SleepMs(uint64_t ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+
+#endif //_TIMER_TEST_HPP